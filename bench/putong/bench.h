@@ -0,0 +1,72 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A minimal micro-benchmark harness for the putong::bench executable.
+//
+// Benchmarks are functions that perform an operation a given number of times. They are
+// registered with PUTONG_BENCHMARK and run by bench_main.cpp, which calibrates the
+// number of iterations and reports the cost per operation.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace putong::bench {
+
+/// @brief A benchmark that performs its operation a given number of times.
+struct Benchmark {
+  std::string name;
+  void (*fn)(uint64_t iterations);
+};
+
+/// @brief Return all registered benchmarks.
+inline auto Registered() -> std::vector<Benchmark>& {
+  static std::vector<Benchmark> benchmarks;
+  return benchmarks;
+}
+
+/// @brief Registers a benchmark during static initialization.
+struct Registrar {
+  Registrar(std::string name, void (*fn)(uint64_t)) {
+    Registered().push_back({std::move(name), fn});
+  }
+};
+
+/// @brief Prevent the compiler from optimizing away the computation of value.
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "r,m"(value) : "memory");
+#else
+  static volatile const void* sink;
+  sink = &value;
+#endif
+}
+
+}  // namespace putong::bench
+
+#define PUTONG_BENCHMARK_CONCAT_(a, b) a##b
+#define PUTONG_BENCHMARK_CONCAT(a, b) PUTONG_BENCHMARK_CONCAT_(a, b)
+
+/// @brief Define and register a benchmark with the given name. The body of the
+/// benchmark performs its operation `iterations` times.
+#define PUTONG_BENCHMARK(name)                                                          \
+  static void PUTONG_BENCHMARK_CONCAT(putong_bench_, __LINE__)(uint64_t iterations);    \
+  static const ::putong::bench::Registrar PUTONG_BENCHMARK_CONCAT(putong_bench_reg_,    \
+                                                                  __LINE__)(            \
+      name, &PUTONG_BENCHMARK_CONCAT(putong_bench_, __LINE__));                         \
+  static void PUTONG_BENCHMARK_CONCAT(putong_bench_, __LINE__)(uint64_t iterations)
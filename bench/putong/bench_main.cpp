@@ -0,0 +1,121 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs the registered micro-benchmarks and prints the cost per operation.
+//
+// The number of iterations of every benchmark is doubled until one run takes at least
+// the minimum time, after which the benchmark is run a number of times. The median and
+// the minimum time per operation of these runs are reported, one line per benchmark,
+// as JSON objects (the default) or as CSV.
+//
+// Usage: putong-bench [--format=json|csv] [--filter=substring] [--min-ms=10]
+//                     [--repetitions=5]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "./bench.h"
+#include "putong/timer.h"
+
+namespace {
+
+struct Options {
+  bool csv = false;
+  std::string filter;
+  int64_t min_ns = 10000000;
+  int repetitions = 5;
+};
+
+auto Run(void (*fn)(uint64_t), uint64_t iterations) -> int64_t {
+  putong::Timer<> t(true);
+  fn(iterations);
+  t.Stop();
+  return t.nanoseconds();
+}
+
+auto Parse(int argc, char* argv[], Options* options) -> bool {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    auto value = arg.substr(arg.find('=') + 1);
+    if (arg == "--format=csv") {
+      options->csv = true;
+    } else if (arg == "--format=json") {
+      options->csv = false;
+    } else if (arg.rfind("--filter=", 0) == 0) {
+      options->filter = value;
+    } else if (arg.rfind("--min-ms=", 0) == 0) {
+      options->min_ns = std::atoll(value.c_str()) * 1000000;
+    } else if (arg.rfind("--repetitions=", 0) == 0) {
+      options->repetitions = std::max(1, std::atoi(value.c_str()));
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int {
+  Options options;
+  if (!Parse(argc, argv, &options)) {
+    std::fprintf(stderr,
+                 "Usage: %s [--format=json|csv] [--filter=substring] [--min-ms=10] "
+                 "[--repetitions=5]\n",
+                 argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  auto benchmarks = putong::bench::Registered();
+  std::sort(benchmarks.begin(), benchmarks.end(),
+            [](const auto& a, const auto& b) { return a.name < b.name; });
+
+  if (options.csv) std::printf("name,iterations,repetitions,median_ns,min_ns\n");
+  for (const auto& b : benchmarks) {
+    if (b.name.find(options.filter) == std::string::npos) continue;
+
+    // Warm up, so that one-time initialization, e.g. of clocks, is not measured.
+    Run(b.fn, 1);
+    uint64_t iterations = 1;
+    while (Run(b.fn, iterations) < options.min_ns && iterations < (1ull << 40)) {
+      iterations *= 2;
+    }
+
+    std::vector<double> ns_per_op;
+    for (int r = 0; r < options.repetitions; r++) {
+      ns_per_op.push_back(static_cast<double>(Run(b.fn, iterations)) / iterations);
+    }
+    std::sort(ns_per_op.begin(), ns_per_op.end());
+    auto median = ns_per_op[ns_per_op.size() / 2];
+    auto min = ns_per_op.front();
+
+    if (options.csv) {
+      std::printf("%s,%llu,%d,%.3f,%.3f\n", b.name.c_str(),
+                  static_cast<unsigned long long>(iterations), options.repetitions,
+                  median, min);
+    } else {
+      std::printf(
+          "{\"name\":\"%s\",\"iterations\":%llu,\"repetitions\":%d,\"median_ns\":%.3f,"
+          "\"min_ns\":%.3f}\n",
+          b.name.c_str(), static_cast<unsigned long long>(iterations),
+          options.repetitions, median, min);
+    }
+    std::fflush(stdout);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,229 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks of the throughput and round-trip latency of the queues, with the producer
+// and consumer pinned to pairs of CPUs, and of a mutex-protected std::deque baseline.
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "./bench.h"
+#include "putong/cpu.h"
+#include "putong/queue.h"
+
+namespace {
+
+using putong::bench::DoNotOptimize;
+
+constexpr size_t kCapacity = 1024;
+constexpr size_t kBatch = 32;
+constexpr uint64_t kProducers = 4;
+
+/// Return the CPU of the consumer, and the CPU of the producer at the given distance.
+auto CpuPair(size_t distance) -> std::pair<int, int> {
+  static auto cpus = putong::OnlineCpus();
+  return {cpus.front(), cpus[std::min(distance, cpus.size() - 1)]};
+}
+
+/// Run producer() and consumer() on threads pinned to the CPUs at the given distance.
+/// The calling thread is not pinned, so that it does not affect other benchmarks.
+template <typename Producer, typename Consumer>
+void RunPair(size_t distance, Producer&& producer, Consumer&& consumer) {
+  auto [consumer_cpu, producer_cpu] = CpuPair(distance);
+  std::thread producer_thread([&, cpu = producer_cpu] {
+    putong::PinThisThread(cpu);
+    producer();
+  });
+  std::thread consumer_thread([&, cpu = consumer_cpu] {
+    putong::PinThisThread(cpu);
+    consumer();
+  });
+  producer_thread.join();
+  consumer_thread.join();
+}
+
+template <size_t distance>
+void SpscThroughput(uint64_t iterations) {
+  putong::SpscQueue<uint64_t> queue(kCapacity);
+  RunPair(
+      distance,
+      [&] {
+        for (uint64_t i = 0; i < iterations; i++) {
+          while (!queue.TryPush(i)) std::this_thread::yield();
+        }
+      },
+      [&] {
+        uint64_t value = 0;
+        for (uint64_t i = 0; i < iterations; i++) {
+          while (!queue.TryPop(&value)) std::this_thread::yield();
+          DoNotOptimize(value);
+        }
+      });
+}
+
+template <size_t distance>
+void SpscBatchThroughput(uint64_t iterations) {
+  putong::SpscQueue<uint64_t> queue(kCapacity);
+  RunPair(
+      distance,
+      [&] {
+        uint64_t items[kBatch] = {};
+        for (uint64_t i = 0; i < iterations;) {
+          auto n = queue.TryPushBatch(items, std::min<uint64_t>(kBatch, iterations - i));
+          if (n == 0) std::this_thread::yield();
+          i += n;
+        }
+      },
+      [&] {
+        uint64_t items[kBatch];
+        for (uint64_t i = 0; i < iterations;) {
+          auto n = queue.TryPopBatch(items, kBatch);
+          if (n == 0) std::this_thread::yield();
+          DoNotOptimize(items);
+          i += n;
+        }
+      });
+}
+
+/// Measures the round-trip latency of a ping through one queue and a pong through
+/// another.
+template <size_t distance>
+void SpscPingPong(uint64_t iterations) {
+  putong::SpscQueue<uint64_t> ping(2);
+  putong::SpscQueue<uint64_t> pong(2);
+  RunPair(
+      distance,
+      [&] {
+        uint64_t value = 0;
+        for (uint64_t i = 0; i < iterations; i++) {
+          while (!ping.TryPop(&value)) std::this_thread::yield();
+          while (!pong.TryPush(value)) std::this_thread::yield();
+        }
+      },
+      [&] {
+        uint64_t value = 0;
+        for (uint64_t i = 0; i < iterations; i++) {
+          while (!ping.TryPush(i)) std::this_thread::yield();
+          while (!pong.TryPop(&value)) std::this_thread::yield();
+        }
+      });
+}
+
+/// Registers the benchmarks of a producer at the given distance from the consumer.
+template <size_t distance>
+struct PairBenchmarks {
+  PairBenchmarks() {
+    auto [consumer_cpu, producer_cpu] = CpuPair(distance);
+    // Skip distances that collapse onto a pair that was already registered.
+    if (distance > 0 && CpuPair(distance - 1).second == producer_cpu) return;
+    auto pair = "/cpu" + std::to_string(producer_cpu) + "-cpu" +
+                std::to_string(consumer_cpu);
+    putong::bench::Registrar("queue/spsc" + pair, &SpscThroughput<distance>);
+    putong::bench::Registrar("queue/spsc_batch" + pair, &SpscBatchThroughput<distance>);
+    putong::bench::Registrar("queue/spsc_ping_pong" + pair, &SpscPingPong<distance>);
+  }
+};
+
+const PairBenchmarks<0> pair0;
+const PairBenchmarks<1> pair1;
+const PairBenchmarks<2> pair2;
+const PairBenchmarks<3> pair3;
+
+/// Run kProducers threads that each call producer(n) with an equal share of the
+/// iterations, and consumer() on the calling thread.
+template <typename Producer, typename Consumer>
+void RunProducers(uint64_t iterations, Producer&& producer, Consumer&& consumer) {
+  std::vector<std::thread> threads;
+  for (uint64_t p = 0; p < kProducers; p++) {
+    auto n = iterations / kProducers + (p < iterations % kProducers ? 1 : 0);
+    threads.emplace_back([&producer, n] { producer(n); });
+  }
+  consumer();
+  for (auto& t : threads) t.join();
+}
+
+PUTONG_BENCHMARK("queue/mpsc/4_producers") {
+  putong::MpscQueue<uint64_t> queue(kCapacity);
+  RunProducers(
+      iterations,
+      [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+          while (!queue.TryPush(i)) std::this_thread::yield();
+        }
+      },
+      [&] {
+        uint64_t value = 0;
+        for (uint64_t i = 0; i < iterations; i++) {
+          while (!queue.TryPop(&value)) std::this_thread::yield();
+          DoNotOptimize(value);
+        }
+      });
+}
+
+PUTONG_BENCHMARK("queue/mpsc_blocking/4_producers") {
+  putong::MpscQueue<uint64_t, true> queue(kCapacity);
+  RunProducers(
+      iterations,
+      [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) queue.Push(i);
+      },
+      [&] {
+        uint64_t value = 0;
+        for (uint64_t i = 0; i < iterations; i++) {
+          queue.Pop(&value);
+          DoNotOptimize(value);
+        }
+      });
+}
+
+auto TryPush(std::mutex* mutex, std::deque<uint64_t>* queue, uint64_t value) -> bool {
+  std::lock_guard<std::mutex> lock(*mutex);
+  if (queue->size() >= kCapacity) return false;
+  queue->push_back(value);
+  return true;
+}
+
+auto TryPop(std::mutex* mutex, std::deque<uint64_t>* queue, uint64_t* value) -> bool {
+  std::lock_guard<std::mutex> lock(*mutex);
+  if (queue->empty()) return false;
+  *value = queue->front();
+  queue->pop_front();
+  return true;
+}
+
+PUTONG_BENCHMARK("queue/mutex_deque/4_producers") {
+  std::mutex mutex;
+  std::deque<uint64_t> queue;
+  RunProducers(
+      iterations,
+      [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+          while (!TryPush(&mutex, &queue, i)) std::this_thread::yield();
+        }
+      },
+      [&] {
+        uint64_t value = 0;
+        for (uint64_t i = 0; i < iterations; i++) {
+          while (!TryPop(&mutex, &queue, &value)) std::this_thread::yield();
+          DoNotOptimize(value);
+        }
+      });
+}
+
+}  // namespace
@@ -0,0 +1,71 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks of the cost of returning a Status through a call.
+
+#include <cerrno>
+
+#include "./bench.h"
+#include "putong/status.h"
+
+namespace {
+
+using putong::bench::DoNotOptimize;
+
+enum class Error { Failed };
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PUTONG_BENCH_NOINLINE __attribute__((noinline))
+#else
+#define PUTONG_BENCH_NOINLINE
+#endif
+
+PUTONG_BENCH_NOINLINE auto Ok() -> putong::Status<Error> {
+  return putong::Status<Error>::OK();
+}
+
+PUTONG_BENCH_NOINLINE auto Fail() -> putong::Status<Error> {
+  return putong::Status<Error>(Error::Failed, "failed");
+}
+
+PUTONG_BENCH_NOINLINE auto FailWithContext() -> putong::Status<Error> {
+  return Fail().WithContext("while benchmarking");
+}
+
+PUTONG_BENCH_NOINLINE auto FailErrno() -> putong::Status<Error> {
+  return putong::Status<Error>::FromErrno(Error::Failed, ENOENT);
+}
+
+PUTONG_BENCHMARK("status/ok") {
+  for (uint64_t i = 0; i < iterations; i++) DoNotOptimize(Ok().ok());
+}
+
+PUTONG_BENCHMARK("status/error") {
+  for (uint64_t i = 0; i < iterations; i++) DoNotOptimize(Fail().ok());
+}
+
+PUTONG_BENCHMARK("status/error_with_context") {
+  for (uint64_t i = 0; i < iterations; i++) DoNotOptimize(FailWithContext().ok());
+}
+
+PUTONG_BENCHMARK("status/error_errno") {
+  for (uint64_t i = 0; i < iterations; i++) DoNotOptimize(FailErrno().ok());
+}
+
+PUTONG_BENCHMARK("status/msg") {
+  auto status = FailWithContext();
+  for (uint64_t i = 0; i < iterations; i++) DoNotOptimize(status.msg());
+}
+
+}  // namespace
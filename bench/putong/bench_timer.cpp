@@ -0,0 +1,126 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks of the per-call cost of the clocks and of Timer and SplitTimer with each
+// clock.
+
+#include <chrono>
+#include <sstream>
+
+#include "./bench.h"
+#include "putong/clock.h"
+#include "putong/dual_timer.h"
+#include "putong/timer.h"
+#include "putong/timer_report.h"
+#include "putong/tsc_skew.h"
+
+namespace {
+
+using putong::bench::DoNotOptimize;
+
+template <typename clock>
+void Now(uint64_t iterations) {
+  for (uint64_t i = 0; i < iterations; i++) DoNotOptimize(clock::now());
+}
+
+template <typename clock>
+void StartStop(uint64_t iterations) {
+  putong::Timer<clock> t;
+  for (uint64_t i = 0; i < iterations; i++) {
+    t.Start();
+    t.Stop();
+    DoNotOptimize(t);
+  }
+}
+
+template <typename clock>
+void Split(uint64_t iterations) {
+  putong::SplitTimer<4, clock> t;
+  for (uint64_t i = 0; i < iterations; i++) {
+    t.Start();
+    t.Split();
+    t.Split();
+    t.Split();
+    t.Split();
+    DoNotOptimize(t);
+  }
+}
+
+/// Registers the now, start/stop and split benchmarks of a clock.
+template <typename clock>
+struct ClockBenchmarks {
+  explicit ClockBenchmarks(const std::string& name) {
+    putong::bench::Registrar("clock/" + name + "/now", &Now<clock>);
+    putong::bench::Registrar("timer/" + name + "/start_stop", &StartStop<clock>);
+    putong::bench::Registrar("split_timer/" + name + "/start_split4", &Split<clock>);
+  }
+};
+
+const ClockBenchmarks<std::chrono::steady_clock> steady("steady_clock");
+const ClockBenchmarks<std::chrono::system_clock> system("system_clock");
+const ClockBenchmarks<std::chrono::high_resolution_clock> high_resolution(
+    "high_resolution_clock");
+const ClockBenchmarks<putong::dispatch_clock> dispatch("dispatch_clock");
+#if defined(__linux__)
+const ClockBenchmarks<putong::monotonic_raw_clock> monotonic_raw("monotonic_raw_clock");
+const ClockBenchmarks<putong::monotonic_coarse_clock> monotonic_coarse(
+    "monotonic_coarse_clock");
+const ClockBenchmarks<putong::thread_cpu_clock> thread_cpu("thread_cpu_clock");
+#endif
+#if PUTONG_HAS_TSC
+const ClockBenchmarks<putong::tsc_clock> tsc("tsc_clock");
+const ClockBenchmarks<putong::corrected_tsc_clock> corrected_tsc("corrected_tsc_clock");
+#endif
+
+#if defined(__linux__)
+PUTONG_BENCHMARK("dual_timer/start_split4") {
+  putong::DualTimer<4> t;
+  for (uint64_t i = 0; i < iterations; i++) {
+    t.Start();
+    t.Split();
+    t.Split();
+    t.Split();
+    t.Split();
+    DoNotOptimize(t);
+  }
+}
+#endif
+
+PUTONG_BENCHMARK("timer/nanoseconds") {
+  putong::Timer<> t(true);
+  t.Stop();
+  for (uint64_t i = 0; i < iterations; i++) {
+    DoNotOptimize(t);
+    DoNotOptimize(t.nanoseconds());
+  }
+}
+
+PUTONG_BENCHMARK("report/timer_str") {
+  putong::Timer<> t(true);
+  t.Stop();
+  for (uint64_t i = 0; i < iterations; i++) DoNotOptimize(putong::str(t));
+}
+
+PUTONG_BENCHMARK("report/split_timer") {
+  putong::SplitTimer<4> t(true);
+  for (int i = 0; i < 4; i++) t.Split();
+  std::ostringstream ss;
+  for (uint64_t i = 0; i < iterations; i++) {
+    ss.str({});
+    putong::report(t, ss);
+    DoNotOptimize(ss);
+  }
+}
+
+}  // namespace
@@ -0,0 +1,25 @@
+# Compares incremental rebuilds of units that include putong/putong.h with units that
+# import the putong module. Run through the putong-module-bench target.
+#
+# For each kind, all units are touched and their target is rebuilt. The module interface
+# itself is up to date, so this measures what a change to a consumer costs.
+
+foreach(kind IN ITEMS putong module)
+  file(GLOB units ${UNIT_DIR}/${kind}/*.cpp)
+  list(LENGTH units count)
+  file(TOUCH ${units})
+
+  string(TIMESTAMP start "%s%f")
+  execute_process(
+    COMMAND ${CMAKE_COMMAND} --build ${BINARY_DIR} --target putong-module-bench-${kind}
+    OUTPUT_QUIET
+    RESULT_VARIABLE result
+  )
+  string(TIMESTAMP stop "%s%f")
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "Unable to rebuild putong-module-bench-${kind}.")
+  endif()
+
+  math(EXPR elapsed_ms "(${stop} - ${start}) / 1000")
+  message(STATUS "${kind}: rebuilt ${count} units in ${elapsed_ms} ms")
+endforeach()
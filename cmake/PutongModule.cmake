@@ -0,0 +1,66 @@
+# Builds the putong C++20 named module, if PUTONG_BUILD_MODULE is ON and the toolchain
+# supports it.
+#
+# The module is built by the putong-module library (alias putong::module), which links
+# the putong interface unit. Consumers link putong::module and use `import putong;`.
+#
+# With BUILD_BENCHMARKS=ON, the putong-module-bench target compares the incremental
+# rebuild time of a set of units that include putong/putong.h with that of the same set
+# of units importing the module.
+
+if(NOT PUTONG_BUILD_MODULE)
+  return()
+endif()
+
+if(CMAKE_VERSION VERSION_LESS 3.28)
+  message(WARNING "The putong module requires CMake 3.28 or newer, skipping it.")
+  return()
+endif()
+
+if(NOT ((CMAKE_CXX_COMPILER_ID STREQUAL "GNU" AND
+         CMAKE_CXX_COMPILER_VERSION VERSION_GREATER_EQUAL 14) OR
+        (CMAKE_CXX_COMPILER_ID MATCHES "Clang" AND
+         CMAKE_CXX_COMPILER_VERSION VERSION_GREATER_EQUAL 16) OR
+        (CMAKE_CXX_COMPILER_ID STREQUAL "MSVC" AND
+         CMAKE_CXX_COMPILER_VERSION VERSION_GREATER_EQUAL 19.34)))
+  message(WARNING "The putong module is not supported by ${CMAKE_CXX_COMPILER_ID} "
+                  "${CMAKE_CXX_COMPILER_VERSION}, skipping it.")
+  return()
+endif()
+
+add_library(putong-module)
+add_library(putong::module ALIAS putong-module)
+target_sources(putong-module
+  PUBLIC
+    FILE_SET CXX_MODULES
+    BASE_DIRS ${PROJECT_SOURCE_DIR}/include
+    FILES ${PROJECT_SOURCE_DIR}/include/putong/putong.cppm
+)
+target_compile_features(putong-module PUBLIC cxx_std_20)
+target_link_libraries(putong-module PUBLIC putong)
+
+if(NOT BUILD_BENCHMARKS)
+  return()
+endif()
+
+set(PUTONG_MODULE_BENCH_UNITS 16)
+foreach(kind IN ITEMS putong module)
+  set(sources)
+  foreach(i RANGE 1 ${PUTONG_MODULE_BENCH_UNITS})
+    set(unit ${CMAKE_CURRENT_BINARY_DIR}/module-bench/${kind}/unit_${i}.cpp)
+    configure_file(${PROJECT_SOURCE_DIR}/bench/putong/compile/${kind}.cpp ${unit} COPYONLY)
+    list(APPEND sources ${unit})
+  endforeach()
+  add_library(putong-module-bench-${kind} OBJECT ${sources})
+  target_compile_features(putong-module-bench-${kind} PRIVATE cxx_std_20)
+  target_link_libraries(putong-module-bench-${kind} PRIVATE putong-module)
+endforeach()
+
+add_custom_target(putong-module-bench
+  COMMAND ${CMAKE_COMMAND}
+    -D BINARY_DIR=${CMAKE_BINARY_DIR}
+    -D UNIT_DIR=${CMAKE_CURRENT_BINARY_DIR}/module-bench
+    -P ${PROJECT_SOURCE_DIR}/cmake/ModuleBench.cmake
+  DEPENDS putong-module-bench-putong putong-module-bench-module
+  USES_TERMINAL
+)
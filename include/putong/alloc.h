@@ -0,0 +1,124 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "putong/timer.h"
+
+namespace putong {
+
+/**
+ * \brief Allocation counters of a thread.
+ *
+ * The counters are only updated if the program includes putong/alloc_hooks.h in exactly
+ * one translation unit, which replaces the global operator new and operator delete.
+ * Otherwise they stay zero, and sampling them costs one thread-local read.
+ */
+struct AllocStats {
+  /// The number of calls to operator new.
+  uint64_t allocations = 0;
+  /// The number of bytes requested from operator new.
+  uint64_t bytes = 0;
+  /// The number of calls to operator delete with a non-null pointer.
+  uint64_t deallocations = 0;
+
+  /// @brief Sample the counters of the calling thread.
+  static auto ForThisThread() -> AllocStats;
+
+  /// @brief Return whether putong/alloc_hooks.h is linked into the program.
+  static auto installed() -> bool;
+
+  /// @brief Return the difference of two samples.
+  auto operator-(const AllocStats& other) const -> AllocStats {
+    return {allocations - other.allocations, bytes - other.bytes,
+            deallocations - other.deallocations};
+  }
+};
+
+namespace internal {
+
+/// The counters of every thread. They are constant-initialized, so that the operators
+/// of putong/alloc_hooks.h can update them without a guard, even during static
+/// initialization.
+inline thread_local AllocStats alloc_stats;
+
+/// Set by putong/alloc_hooks.h during static initialization.
+inline std::atomic<bool> alloc_hooks_installed = false;
+
+}  // namespace internal
+
+inline auto AllocStats::ForThisThread() -> AllocStats { return internal::alloc_stats; }
+
+inline auto AllocStats::installed() -> bool {
+  return internal::alloc_hooks_installed.load(std::memory_order_relaxed);
+}
+
+/**
+ * \brief A split timer that also counts the allocations of the calling thread per split.
+ *
+ * This shows which stage of a hot loop allocates, next to how long it takes. It needs
+ * putong/alloc_hooks.h to be linked in, and otherwise reports zero allocations. All calls
+ * must be made on the same thread.
+ *
+ * \tparam num_splits The number of splits.
+ * \tparam clock The clock to use.
+ */
+template <unsigned int num_splits = 1, typename clock = std::chrono::steady_clock>
+struct AllocTimer {
+  SplitTimer<num_splits, clock> time;
+  AllocStats allocs[num_splits + 1];
+
+  /// @brief Construct a new timer. This also starts the timer if start=true.
+  explicit AllocTimer(bool start = false) {
+    if (start) Start();
+  }
+
+  /// @brief Start the timer.
+  inline void Start() {
+    allocs[0] = AllocStats::ForThisThread();
+    time.Start();
+  }
+
+  /// @brief Record a split time and the allocation counters.
+  inline void Split() {
+    auto idx = time.split_idx.load(std::memory_order_relaxed);
+    time.Split();
+    allocs[idx] = AllocStats::ForThisThread();
+  }
+
+  /// @brief Retrieve split interval i in nanoseconds.
+  [[nodiscard]] inline auto nanoseconds(size_t i) const -> int64_t {
+    return time.nanoseconds(i);
+  }
+
+  /// @brief Retrieve the allocation counters of split interval i.
+  [[nodiscard]] inline auto stats(size_t i) const -> AllocStats {
+    return allocs[i + 1] - allocs[i];
+  }
+
+  /// @brief Retrieve the number of allocations of split interval i.
+  [[nodiscard]] inline auto allocations(size_t i) const -> uint64_t {
+    return stats(i).allocations;
+  }
+
+  /// @brief Retrieve the number of bytes allocated in split interval i.
+  [[nodiscard]] inline auto bytes(size_t i) const -> uint64_t { return stats(i).bytes; }
+};
+
+}  // namespace putong
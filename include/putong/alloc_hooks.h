@@ -0,0 +1,157 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "putong/alloc.h"
+
+/// @file
+/// @brief Replacements of the global operator new and operator delete that count the
+/// allocations of every thread in AllocStats.
+///
+/// This header defines the replacement functions, so it must be included in exactly one
+/// translation unit of a program, e.g. the one with main(). It is therefore not included
+/// by putong/putong.h. A program that does not include it uses the default operators and
+/// pays nothing. Otherwise, every allocation costs two thread-local increments on top of
+/// malloc(). Memory that is allocated with malloc() directly is not counted. Aligned
+/// allocation uses posix_memalign().
+
+namespace putong::internal {
+
+inline auto CountedNew(std::size_t size, std::size_t alignment) -> void* {
+  auto& stats = alloc_stats;
+  stats.allocations++;
+  stats.bytes += size;
+  if (size == 0) size = 1;
+  for (;;) {
+    void* p = nullptr;
+    if (alignment <= alignof(std::max_align_t)) {
+      p = std::malloc(size);
+    } else if (posix_memalign(&p, std::max(alignment, sizeof(void*)), size) != 0) {
+      p = nullptr;
+    }
+    if (p != nullptr) return p;
+    auto handler = std::get_new_handler();
+    if (handler == nullptr) throw std::bad_alloc();
+    handler();
+  }
+}
+
+inline auto CountedNewNoThrow(std::size_t size, std::size_t alignment) noexcept -> void* {
+  try {
+    return CountedNew(size, alignment);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+inline void CountedDelete(void* p) noexcept {
+  if (p == nullptr) return;
+  alloc_stats.deallocations++;
+  std::free(p);
+}
+
+namespace {
+[[maybe_unused]] const bool alloc_hooks_registered =
+    (alloc_hooks_installed.store(true, std::memory_order_relaxed), true);
+}  // namespace
+
+}  // namespace putong::internal
+
+auto operator new(std::size_t size) -> void* {
+  return putong::internal::CountedNew(size, 0);
+}
+
+auto operator new[](std::size_t size) -> void* {
+  return putong::internal::CountedNew(size, 0);
+}
+
+auto operator new(std::size_t size, const std::nothrow_t& /*tag*/) noexcept -> void* {
+  return putong::internal::CountedNewNoThrow(size, 0);
+}
+
+auto operator new[](std::size_t size, const std::nothrow_t& /*tag*/) noexcept -> void* {
+  return putong::internal::CountedNewNoThrow(size, 0);
+}
+
+auto operator new(std::size_t size, std::align_val_t alignment) -> void* {
+  return putong::internal::CountedNew(size, static_cast<std::size_t>(alignment));
+}
+
+auto operator new[](std::size_t size, std::align_val_t alignment) -> void* {
+  return putong::internal::CountedNew(size, static_cast<std::size_t>(alignment));
+}
+
+auto operator new(std::size_t size, std::align_val_t alignment,
+                  const std::nothrow_t& /*tag*/) noexcept -> void* {
+  return putong::internal::CountedNewNoThrow(size, static_cast<std::size_t>(alignment));
+}
+
+auto operator new[](std::size_t size, std::align_val_t alignment,
+                    const std::nothrow_t& /*tag*/) noexcept -> void* {
+  return putong::internal::CountedNewNoThrow(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* p) noexcept { putong::internal::CountedDelete(p); }
+
+void operator delete[](void* p) noexcept { putong::internal::CountedDelete(p); }
+
+void operator delete(void* p, std::size_t /*size*/) noexcept {
+  putong::internal::CountedDelete(p);
+}
+
+void operator delete[](void* p, std::size_t /*size*/) noexcept {
+  putong::internal::CountedDelete(p);
+}
+
+void operator delete(void* p, const std::nothrow_t& /*tag*/) noexcept {
+  putong::internal::CountedDelete(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t& /*tag*/) noexcept {
+  putong::internal::CountedDelete(p);
+}
+
+void operator delete(void* p, std::align_val_t /*alignment*/) noexcept {
+  putong::internal::CountedDelete(p);
+}
+
+void operator delete[](void* p, std::align_val_t /*alignment*/) noexcept {
+  putong::internal::CountedDelete(p);
+}
+
+void operator delete(void* p, std::size_t /*size*/,
+                     std::align_val_t /*alignment*/) noexcept {
+  putong::internal::CountedDelete(p);
+}
+
+void operator delete[](void* p, std::size_t /*size*/,
+                       std::align_val_t /*alignment*/) noexcept {
+  putong::internal::CountedDelete(p);
+}
+
+void operator delete(void* p, std::align_val_t /*alignment*/,
+                     const std::nothrow_t& /*tag*/) noexcept {
+  putong::internal::CountedDelete(p);
+}
+
+void operator delete[](void* p, std::align_val_t /*alignment*/,
+                       const std::nothrow_t& /*tag*/) noexcept {
+  putong::internal::CountedDelete(p);
+}
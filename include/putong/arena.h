@@ -0,0 +1,210 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include "putong/histogram.h"
+#include "putong/status.h"
+#include "putong/timer.h"
+
+namespace putong {
+
+enum class ArenaError { Alignment, Exhausted, OutOfMemory };
+
+/**
+ * \brief A monotonic bump allocator for short-lived scratch memory.
+ *
+ * Allocations are served from an inline block first, and then from heap blocks that
+ * double in size. Memory is never freed individually. Reset() makes all memory
+ * available again in constant time, keeping the heap blocks to be reused in order, so an
+ * arena that is reset per request stops allocating from the heap once it has grown to
+ * the size of the largest request.
+ *
+ * The total size of the inline and heap blocks can be capped, in which case allocations
+ * that would exceed the cap fail with ArenaError::Exhausted rather than throwing.
+ *
+ * \tparam inline_bytes The size of the inline block.
+ */
+template <size_t inline_bytes = 1024>
+class Arena {
+  static_assert(inline_bytes > 0);
+
+ public:
+  /**
+   * \brief Construct an arena.
+   * \param max_bytes The maximum total size of the inline and heap blocks.
+   * \param block_latency If not null, receives the latency of every heap block
+   *                      allocation in nanoseconds.
+   */
+  explicit Arena(size_t max_bytes = SIZE_MAX, Histogram* block_latency = nullptr)
+      : max_bytes_(max_bytes), block_latency_(block_latency) {}
+
+  Arena(const Arena&) = delete;
+  auto operator=(const Arena&) -> Arena& = delete;
+
+  ~Arena() { Release(); }
+
+  /**
+   * \brief Allocate memory.
+   *
+   * \param size The number of bytes to allocate.
+   * \param alignment The alignment, which must be a power of two.
+   * \param out Receives the allocated memory.
+   * \return An error if the alignment is invalid, if the cap would be exceeded, or if the
+   *         heap is out of memory.
+   */
+  auto Allocate(size_t size, size_t alignment, void** out) -> Status<ArenaError> {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+      return Status<ArenaError>(ArenaError::Alignment, "alignment is not a power of two");
+    }
+    if (!TryBump(size, alignment, out)) {
+      auto status = Grow(size, alignment);
+      if (!status.ok()) return status;
+      TryBump(size, alignment, out);
+    }
+    used_ += size;
+    return Status<ArenaError>::OK();
+  }
+
+  /// @brief Allocate uninitialized memory for n objects of type T.
+  template <typename T>
+  auto Allocate(size_t n, T** out) -> Status<ArenaError> {
+    if (n > SIZE_MAX / sizeof(T)) {
+      return Status<ArenaError>(ArenaError::Exhausted, "allocation size overflows");
+    }
+    void* p = nullptr;
+    auto status = Allocate(n * sizeof(T), alignof(T), &p);
+    *out = static_cast<T*>(p);
+    return status;
+  }
+
+  /// @brief Make all memory available again, keeping the heap blocks for reuse.
+  void Reset() {
+    current_ = nullptr;
+    cursor_ = reinterpret_cast<uintptr_t>(inline_);
+    end_ = cursor_ + inline_bytes;
+    used_ = 0;
+  }
+
+  /// @brief Make all memory available again, and free the heap blocks.
+  void Release() {
+    for (auto* b = head_; b != nullptr;) {
+      auto* next = b->next;
+      std::free(b);
+      b = next;
+    }
+    head_ = nullptr;
+    reserved_ = inline_bytes;
+    next_size_ = 2 * inline_bytes;
+    blocks_ = 0;
+    Reset();
+  }
+
+  /// @brief Return the number of bytes allocated since the last reset.
+  [[nodiscard]] auto used() const -> size_t { return used_; }
+
+  /// @brief Return the total size of the inline and heap blocks.
+  [[nodiscard]] auto reserved() const -> size_t { return reserved_; }
+
+  /// @brief Return the number of heap blocks.
+  [[nodiscard]] auto blocks() const -> size_t { return blocks_; }
+
+ private:
+  struct alignas(std::max_align_t) Block {
+    Block* next;
+    size_t size;
+
+    auto begin() -> uintptr_t { return reinterpret_cast<uintptr_t>(this + 1); }
+  };
+
+  auto TryBump(size_t size, size_t alignment, void** out) -> bool {
+    auto p = (cursor_ + alignment - 1) & ~(alignment - 1);
+    if (p < cursor_ || p > end_ || size > end_ - p) return false;
+    cursor_ = p + size;
+    *out = reinterpret_cast<void*>(p);
+    return true;
+  }
+
+  auto Grow(size_t size, size_t alignment) -> Status<ArenaError> {
+    // Block data is aligned to max_align_t, so only larger alignments need padding.
+    auto padding = alignment > alignof(std::max_align_t) ? alignment - 1 : 0;
+    if (size > SIZE_MAX - padding) {
+      return Status<ArenaError>(ArenaError::Exhausted, "allocation size overflows");
+    }
+    auto needed = size + padding;
+
+    // Reuse the next block that was kept by Reset(), if it is large enough.
+    auto* next = current_ == nullptr ? head_ : current_->next;
+    if (next != nullptr && next->size >= needed) {
+      Enter(next);
+      return Status<ArenaError>::OK();
+    }
+
+    auto block_size = std::max(next_size_, needed);
+    if (block_size > max_bytes_ - std::min(reserved_, max_bytes_)) block_size = needed;
+    if (block_size > max_bytes_ - std::min(reserved_, max_bytes_)) {
+      return Status<ArenaError>(ArenaError::Exhausted, "arena cap exceeded");
+    }
+
+    Timer<> timer(block_latency_ != nullptr);
+    auto* block = static_cast<Block*>(std::malloc(sizeof(Block) + block_size));
+    if (block_latency_ != nullptr) {
+      timer.Stop();
+      block_latency_->Record(timer);
+    }
+    if (block == nullptr) {
+      return Status<ArenaError>(ArenaError::OutOfMemory, "unable to allocate block");
+    }
+
+    // Insert the new block after the current one, keeping blocks that follow it.
+    block->next = next;
+    block->size = block_size;
+    if (current_ == nullptr) {
+      head_ = block;
+    } else {
+      current_->next = block;
+    }
+    reserved_ += block_size;
+    next_size_ = std::max(next_size_, block_size) * 2;
+    blocks_++;
+    Enter(block);
+    return Status<ArenaError>::OK();
+  }
+
+  void Enter(Block* block) {
+    current_ = block;
+    cursor_ = block->begin();
+    end_ = cursor_ + block->size;
+  }
+
+  alignas(std::max_align_t) char inline_[inline_bytes];
+  uintptr_t cursor_ = reinterpret_cast<uintptr_t>(inline_);
+  uintptr_t end_ = cursor_ + inline_bytes;
+  /// The block that is allocated from, or null for the inline block.
+  Block* current_ = nullptr;
+  Block* head_ = nullptr;
+  size_t used_ = 0;
+  size_t reserved_ = inline_bytes;
+  size_t next_size_ = 2 * inline_bytes;
+  size_t blocks_ = 0;
+  size_t max_bytes_;
+  Histogram* block_latency_;
+};
+
+}  // namespace putong
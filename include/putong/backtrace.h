@@ -0,0 +1,164 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#if defined(__has_include)
+#if __has_include(<unwind.h>) && __has_include(<dlfcn.h>) && __has_include(<cxxabi.h>)
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <unwind.h>
+#define PUTONG_HAS_UNWIND 1
+#endif
+#endif
+
+#ifndef PUTONG_HAS_UNWIND
+#define PUTONG_HAS_UNWIND 0
+#endif
+
+namespace putong {
+
+/**
+ * \brief Return the demangled name of the function containing pc, or an empty string.
+ *
+ * Symbols are resolved with dladdr, so functions of the main executable are only named
+ * if it exports its symbols, e.g. when it is linked with -rdynamic.
+ *
+ * \param offset If not null, receives the offset of pc from the start of the function.
+ * \param module If not null, receives the path of the object containing pc, if known.
+ */
+inline auto SymbolName(const void* pc, size_t* offset = nullptr,
+                       std::string* module = nullptr) -> std::string {
+  std::string result;
+#if PUTONG_HAS_UNWIND
+  Dl_info info;
+  if (dladdr(pc, &info) == 0) return result;
+  if (module != nullptr && info.dli_fname != nullptr) *module = info.dli_fname;
+  if (info.dli_sname == nullptr) return result;
+  int status = -1;
+  char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+  result = status == 0 ? demangled : info.dli_sname;
+  std::free(demangled);
+  if (offset != nullptr) {
+    *offset = reinterpret_cast<uintptr_t>(pc) -
+              reinterpret_cast<uintptr_t>(info.dli_saddr);
+  }
+#else
+  (void)pc;
+  (void)offset;
+  (void)module;
+#endif
+  return result;
+}
+
+/**
+ * \brief A fixed-capacity array of raw return addresses.
+ *
+ * Capturing only stores program counters, which keeps it cheap enough to do whenever an
+ * error is created. Turning the addresses into symbol names is deferred to str().
+ *
+ * \tparam depth The maximum number of frames to record.
+ */
+template <size_t depth>
+class Backtrace {
+  static_assert(depth > 0 && depth < 256);
+
+ public:
+  /**
+   * \brief Record the return addresses of the calling stack.
+   *
+   * Frame 0 is the function that called Capture(), unless skip frames are skipped. With
+   * a depth of one and no frames to skip, only the return address of this call is
+   * stored, which does not need to unwind. Otherwise, the stack is unwound up to the
+   * depth cap.
+   */
+#if defined(__GNUC__) || defined(__clang__)
+  __attribute__((noinline))
+#endif
+  void Capture(size_t skip = 0) {
+    size_ = 0;
+#if defined(__GNUC__) || defined(__clang__)
+    if (depth == 1 && skip == 0) {
+      frames_[0] = __builtin_return_address(0);
+      size_ = 1;
+      return;
+    }
+#endif
+#if PUTONG_HAS_UNWIND
+    State state{this, skip + 1};
+    _Unwind_Backtrace(&Backtrace::Unwind, &state);
+#else
+    (void)skip;
+#endif
+  }
+
+  /// @brief Return the number of recorded frames.
+  [[nodiscard]] auto size() const -> size_t { return size_; }
+
+  /// @brief Return the return address of frame i.
+  [[nodiscard]] auto operator[](size_t i) const -> void* { return frames_[i]; }
+
+  /// @brief Symbolize the recorded frames with SymbolName(), one line per frame.
+  [[nodiscard]] auto str() const -> std::string {
+    std::string result;
+    for (size_t i = 0; i < size_; i++) {
+      char line[64];
+      std::snprintf(line, sizeof(line), "  #%zu %p", i, frames_[i]);
+      result += line;
+      size_t offset = 0;
+      std::string module;
+      auto name = SymbolName(frames_[i], &offset, &module);
+      if (!name.empty()) {
+        std::snprintf(line, sizeof(line), "+0x%zx", offset);
+        result += " " + name + line;
+      }
+      if (!module.empty()) result += " (" + module + ")";
+      result += "\n";
+    }
+    return result;
+  }
+
+ private:
+#if PUTONG_HAS_UNWIND
+  struct State {
+    Backtrace* trace;
+    size_t skip;
+  };
+
+  static auto Unwind(struct _Unwind_Context* ctx, void* arg) -> _Unwind_Reason_Code {
+    auto* state = static_cast<State*>(arg);
+    if (state->skip > 0) {
+      state->skip--;
+      return _URC_NO_REASON;
+    }
+    auto pc = _Unwind_GetIP(ctx);
+    if (pc == 0) return _URC_END_OF_STACK;
+    auto* trace = state->trace;
+    trace->frames_[trace->size_++] = reinterpret_cast<void*>(pc);
+    return trace->size_ == depth ? _URC_END_OF_STACK : _URC_NO_REASON;
+  }
+#endif
+
+  std::array<void*, depth> frames_{};
+  uint8_t size_ = 0;
+};
+
+}  // namespace putong
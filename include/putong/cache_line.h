@@ -0,0 +1,30 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+
+namespace putong {
+
+/// @brief The assumed size of a cache line, used to keep data of threads apart.
+inline constexpr size_t kCacheLineSize = 64;
+
+/// @brief A value aligned to and padded to a multiple of the cache line size.
+template <typename T>
+struct alignas(kCacheLineSize) Padded {
+  T value{};
+};
+
+}  // namespace putong
@@ -0,0 +1,463 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#include <cpuid.h>
+#include <x86intrin.h>
+#define PUTONG_HAS_TSC 1
+#else
+#define PUTONG_HAS_TSC 0
+#endif
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/auxv.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/// @file
+/// @brief Clocks that can be used as the clock of Timer and SplitTimer.
+///
+/// All clocks in this file meet the requirements of std::chrono clocks and count in
+/// nanoseconds.
+
+namespace putong {
+
+/// @brief The clock sources that dispatch_clock can select from.
+enum class ClockSource : char { Steady, MonotonicRaw, MonotonicCoarse, Tsc };
+
+namespace internal {
+
+/// @brief Fixed-point conversion from TSC ticks to nanoseconds.
+struct TscCalibration {
+  /// Nanoseconds per tick, as a fixed-point number with 32 fractional bits.
+  uint64_t mult = 0;
+  uint64_t ticks_per_second = 0;
+};
+
+#if PUTONG_HAS_TSC
+inline auto ReadTsc() -> uint64_t { return __rdtsc(); }
+
+/// @brief Return true if the TSC is invariant, i.e. it runs at a constant rate in all
+/// power states.
+inline auto HasInvariantTsc() -> bool {
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0) return false;
+  return (edx & (1u << 8)) != 0;
+}
+
+/// @brief Return the TSC calibration, measuring it against steady_clock on first use.
+inline auto Tsc() -> const TscCalibration& {
+  static const TscCalibration calibration = [] {
+    using namespace std::chrono;
+    auto t0 = steady_clock::now();
+    auto c0 = ReadTsc();
+    while (steady_clock::now() - t0 < milliseconds(20)) {
+    }
+    auto c1 = ReadTsc();
+    auto t1 = steady_clock::now();
+    auto ns = duration_cast<nanoseconds>(t1 - t0).count();
+    TscCalibration result;
+    result.ticks_per_second = static_cast<uint64_t>((c1 - c0) * 1e9 / ns);
+    result.mult = static_cast<uint64_t>((static_cast<double>(ns) * 4294967296.0) /
+                                        static_cast<double>(c1 - c0));
+    return result;
+  }();
+  return calibration;
+}
+#endif
+
+#if defined(__linux__)
+/// @brief Read a value that another agent, e.g. the kernel, may change concurrently, with
+/// a single load that the compiler may not merge, repeat or move across other volatile
+/// loads.
+template <typename T>
+inline auto ReadOnce(const T& value) -> T {
+  return *static_cast<const volatile T*>(&value);
+}
+
+template <clockid_t id>
+auto PosixNow() -> int64_t {
+  timespec ts{};
+  clock_gettime(id, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+template <clockid_t id>
+auto PosixResolution() -> int64_t {
+  timespec ts{};
+  clock_getres(id, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * \brief The perf_event task clock of a thread, read from user space.
+ *
+ * The kernel publishes the task clock at the last context switch in a memory-mapped
+ * page, together with the parameters to convert the TSC to the time since then. Reading
+ * both under the sequence lock of the page gives the current task clock without a
+ * system call. This requires the kernel to support user-space time (cap_user_time),
+ * which is typically unavailable in virtual machines.
+ */
+class PerfTaskClock {
+ public:
+  /// @brief Return the task clock of the calling thread, or nullptr if unavailable.
+  static auto ForThisThread() -> PerfTaskClock* {
+    thread_local PerfTaskClock clock;
+    return clock.page_ != nullptr ? &clock : nullptr;
+  }
+
+  PerfTaskClock(const PerfTaskClock&) = delete;
+  auto operator=(const PerfTaskClock&) -> PerfTaskClock& = delete;
+
+  ~PerfTaskClock() { Close(); }
+
+  /// @brief Return the CPU time of the calling thread in nanoseconds, with the same
+  /// epoch as CLOCK_THREAD_CPUTIME_ID.
+  auto Read() -> int64_t { return base_ + Count(); }
+
+ private:
+  PerfTaskClock() { Open(); }
+
+  void Open() {
+#if PUTONG_HAS_TSC
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_SOFTWARE;
+    attr.config = PERF_COUNT_SW_TASK_CLOCK;
+    fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    if (fd_ < 0) return;
+    void* page = mmap(nullptr, static_cast<size_t>(sysconf(_SC_PAGESIZE)), PROT_READ,
+                      MAP_SHARED, fd_, 0);
+    if (page == MAP_FAILED) {
+      Close();
+      return;
+    }
+    page_ = static_cast<perf_event_mmap_page*>(page);
+    if (!page_->cap_user_time) {
+      Close();
+      return;
+    }
+    base_ = PosixNow<CLOCK_THREAD_CPUTIME_ID>() - Count();
+    // Only trust the page if it agrees with the system call after some work.
+    volatile uint64_t sink = 0;
+    for (int i = 0; i < 100000; i++) sink = sink + i;
+    auto expected = PosixNow<CLOCK_THREAD_CPUTIME_ID>();
+    auto error = Read() - expected;
+    if (error > 100000 || error < -100000) Close();
+#endif
+  }
+
+  auto Count() -> int64_t {
+#if PUTONG_HAS_TSC
+    uint64_t count = 0;
+    uint32_t seq = 0;
+    // The kernel updates the page under the sequence lock, so every field is read once,
+    // with a compiler barrier after the first and before the last read of the lock.
+    do {
+      seq = ReadOnce(page_->lock);
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+      uint64_t cycles = ReadTsc();
+      uint64_t shift = ReadOnce(page_->time_shift);
+      uint64_t mult = ReadOnce(page_->time_mult);
+      uint64_t quot = cycles >> shift;
+      uint64_t rem = cycles & ((uint64_t{1} << shift) - 1);
+      uint64_t delta =
+          ReadOnce(page_->time_offset) + quot * mult + ((rem * mult) >> shift);
+      count = ReadOnce(page_->offset) + delta;
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+    } while (ReadOnce(page_->lock) != seq);
+    return static_cast<int64_t>(count);
+#else
+    return 0;
+#endif
+  }
+
+  void Close() {
+    if (page_ != nullptr) munmap(page_, static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+    if (fd_ >= 0) close(fd_);
+    page_ = nullptr;
+    fd_ = -1;
+  }
+
+  int fd_ = -1;
+  perf_event_mmap_page* page_ = nullptr;
+  int64_t base_ = 0;
+};
+#endif
+
+}  // namespace internal
+
+#if defined(__linux__)
+/**
+ * \brief A clock of the CPU time of the calling thread.
+ *
+ * The clock reads the perf_event task clock from user space where the kernel supports
+ * it, and CLOCK_THREAD_CPUTIME_ID otherwise. The choice is made per thread, on first
+ * use. Time points of different threads are unrelated, so a Timer with this clock must
+ * be started and stopped on the same thread.
+ */
+struct thread_cpu_clock {
+  using rep = int64_t;
+  using period = std::nano;
+  using duration = std::chrono::nanoseconds;
+  using time_point = std::chrono::time_point<thread_cpu_clock>;
+  static constexpr bool is_steady = true;
+
+  static auto now() noexcept -> time_point {
+    if (auto* perf = internal::PerfTaskClock::ForThisThread()) {
+      return time_point(duration(perf->Read()));
+    }
+    return time_point(duration(internal::PosixNow<CLOCK_THREAD_CPUTIME_ID>()));
+  }
+
+  /// @brief Return whether the calling thread reads the perf_event task clock.
+  static auto uses_perf() -> bool {
+    return internal::PerfTaskClock::ForThisThread() != nullptr;
+  }
+};
+
+/// @brief A clock reading CLOCK_MONOTONIC_RAW, which is not slewed by NTP.
+struct monotonic_raw_clock {
+  using rep = int64_t;
+  using period = std::nano;
+  using duration = std::chrono::nanoseconds;
+  using time_point = std::chrono::time_point<monotonic_raw_clock>;
+  static constexpr bool is_steady = true;
+
+  static auto now() noexcept -> time_point {
+    return time_point(duration(internal::PosixNow<CLOCK_MONOTONIC_RAW>()));
+  }
+};
+
+/// @brief A clock reading CLOCK_MONOTONIC_COARSE, which is cheap but only updated every
+/// scheduler tick.
+struct monotonic_coarse_clock {
+  using rep = int64_t;
+  using period = std::nano;
+  using duration = std::chrono::nanoseconds;
+  using time_point = std::chrono::time_point<monotonic_coarse_clock>;
+  static constexpr bool is_steady = true;
+
+  static auto now() noexcept -> time_point {
+    return time_point(duration(internal::PosixNow<CLOCK_MONOTONIC_COARSE>()));
+  }
+};
+#endif
+
+#if PUTONG_HAS_TSC
+/**
+ * \brief A clock reading the time stamp counter of the CPU.
+ *
+ * Ticks are converted to nanoseconds with a fixed-point multiplier that is calibrated
+ * against steady_clock on first use. The clock is only steady if the TSC is invariant,
+ * which can be checked with internal::HasInvariantTsc().
+ */
+struct tsc_clock {
+  using rep = int64_t;
+  using period = std::nano;
+  using duration = std::chrono::nanoseconds;
+  using time_point = std::chrono::time_point<tsc_clock>;
+  static constexpr bool is_steady = true;
+
+  static auto now() noexcept -> time_point { return from_ticks(internal::ReadTsc()); }
+
+  /// @brief Convert a raw TSC value to a time point.
+  static auto from_ticks(uint64_t ticks) noexcept -> time_point {
+    auto ns = (static_cast<unsigned __int128>(ticks) * internal::Tsc().mult) >> 32;
+    return time_point(duration(static_cast<rep>(ns)));
+  }
+};
+#endif
+
+/**
+ * \brief A clock that reads the cheapest suitable source of the host.
+ *
+ * The source is selected once, by Init() or on the first call of now(), by probing all
+ * available sources. A source is suitable if it is steady, has a resolution of at most
+ * max_resolution_ns and, for the TSC, if the TSC is invariant. Of the suitable sources,
+ * the one with the lowest measured overhead per call is selected. Setting the
+ * PUTONG_CLOCK environment variable to the name of a source forces that source, if it
+ * is available. After selection, now() is a load and an indirect call.
+ *
+ * Time points are only comparable within a process, since sources have different epochs.
+ */
+struct dispatch_clock {
+  using rep = int64_t;
+  using period = std::nano;
+  using duration = std::chrono::nanoseconds;
+  using time_point = std::chrono::time_point<dispatch_clock>;
+  static constexpr bool is_steady = true;
+
+  /// @brief The maximum resolution of a suitable source.
+  static constexpr int64_t max_resolution_ns = 1000;
+
+  /// @brief The result of probing a clock source.
+  struct Probe {
+    ClockSource source;
+    const char* name;
+    int64_t (*read)();
+    double overhead_ns;
+    int64_t resolution_ns;
+    bool suitable;
+    /// @brief Why the source is or is not suitable.
+    std::string reason;
+  };
+
+  /// @brief The selected source and the probes of all available sources.
+  struct Selection {
+    ClockSource source;
+    const char* name;
+    /// @brief Why the source was selected.
+    std::string reason;
+    std::vector<Probe> probes;
+  };
+
+  static auto now() noexcept -> time_point {
+    return time_point(duration(read_.load(std::memory_order_relaxed)()));
+  }
+
+  /**
+   * \brief Select the source if that was not done yet.
+   *
+   * Probing allocates, so it may throw. Calling this before the first call of now()
+   * reports such failures here. Otherwise, if the first call of now() fails to select a
+   * source, the clock reads steady_clock. Once now() was called, its source does not
+   * change.
+   */
+  static void Init() {
+    const auto& s = selection();
+    auto read = s.probes.front().read;
+    for (const auto& p : s.probes) {
+      if (p.source == s.source) read = p.read;
+    }
+    int64_t (*expected)() = &FirstNow;
+    read_.compare_exchange_strong(expected, read, std::memory_order_relaxed);
+  }
+
+  /// @brief Return the selected source, probing the host on first use.
+  static auto selection() -> const Selection& {
+    static const Selection selection = Select();
+    return selection;
+  }
+
+ private:
+  static auto SteadyNow() -> int64_t {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+  }
+
+  static auto FirstNow() noexcept -> int64_t {
+    try {
+      Init();
+    } catch (...) {
+      int64_t (*expected)() = &FirstNow;
+      read_.compare_exchange_strong(expected, &SteadyNow, std::memory_order_relaxed);
+    }
+    return read_.load(std::memory_order_relaxed)();
+  }
+
+  static auto Measure(ClockSource source, const char* name, int64_t (*read)(),
+                      int64_t resolution_ns) -> Probe {
+    constexpr int kCalls = 20000;
+    volatile int64_t sink = 0;
+    auto start = SteadyNow();
+    for (int i = 0; i < kCalls; i++) sink = read();
+    auto stop = SteadyNow();
+    (void)sink;
+    double overhead = static_cast<double>(stop - start) / kCalls;
+    return {source, name, read, overhead, resolution_ns, true, ""};
+  }
+
+  static auto Select() -> Selection {
+    std::vector<Probe> probes;
+    char buf[128];
+
+    probes.push_back(Measure(ClockSource::Steady, "steady", &SteadyNow,
+                             std::chrono::steady_clock::period::num * 1000000000 /
+                                 std::chrono::steady_clock::period::den));
+#if defined(__linux__)
+    probes.push_back(Measure(ClockSource::MonotonicRaw, "monotonic_raw",
+                             &internal::PosixNow<CLOCK_MONOTONIC_RAW>,
+                             internal::PosixResolution<CLOCK_MONOTONIC_RAW>()));
+    probes.push_back(Measure(ClockSource::MonotonicCoarse, "monotonic_coarse",
+                             &internal::PosixNow<CLOCK_MONOTONIC_COARSE>,
+                             internal::PosixResolution<CLOCK_MONOTONIC_COARSE>()));
+    bool vdso = getauxval(AT_SYSINFO_EHDR) != 0;
+#else
+    bool vdso = false;
+#endif
+#if PUTONG_HAS_TSC
+    auto& tsc = internal::Tsc();
+    auto tsc_read = [] { return tsc_clock::now().time_since_epoch().count(); };
+    probes.push_back(Measure(ClockSource::Tsc, "tsc", tsc_read,
+                             std::max<int64_t>(1, 1000000000 / tsc.ticks_per_second)));
+    if (!internal::HasInvariantTsc()) {
+      probes.back().suitable = false;
+      probes.back().reason = "TSC is not invariant";
+    }
+#endif
+
+    for (auto& p : probes) {
+      if (p.suitable && p.resolution_ns > max_resolution_ns) {
+        p.suitable = false;
+        std::snprintf(buf, sizeof(buf), "resolution of %lld ns exceeds %lld ns",
+                      static_cast<long long>(p.resolution_ns),
+                      static_cast<long long>(max_resolution_ns));
+        p.reason = buf;
+      } else if (p.suitable) {
+        std::snprintf(buf, sizeof(buf), "%.1f ns per call, resolution of %lld ns",
+                      p.overhead_ns, static_cast<long long>(p.resolution_ns));
+        p.reason = buf;
+        if (p.source != ClockSource::Tsc && p.source != ClockSource::Steady && !vdso) {
+          p.reason += ", no vDSO";
+        }
+      }
+    }
+
+    const Probe* best = &probes.front();
+    std::string reason;
+    const char* forced = std::getenv("PUTONG_CLOCK");
+    for (const auto& p : probes) {
+      if (forced != nullptr && std::strcmp(forced, p.name) == 0) {
+        best = &p;
+        reason = "forced by PUTONG_CLOCK";
+        break;
+      }
+      if (p.suitable && p.overhead_ns < best->overhead_ns) best = &p;
+    }
+    if (reason.empty()) reason = "cheapest suitable source: " + best->reason;
+    return {best->source, best->name, reason, probes};
+  }
+
+  static inline std::atomic<int64_t (*)()> read_ = &FirstNow;
+};
+
+}  // namespace putong
@@ -0,0 +1,171 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// This header is empty unless the compiler supports C++20 coroutines.
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <utility>
+
+#include "putong/timer.h"
+
+namespace putong {
+
+namespace internal {
+
+/// @brief Return the awaiter of an awaitable, as co_await would obtain it.
+template <typename Awaitable>
+decltype(auto) GetAwaiter(Awaitable&& awaitable) {
+  if constexpr (requires { std::forward<Awaitable>(awaitable).operator co_await(); }) {
+    return std::forward<Awaitable>(awaitable).operator co_await();
+  } else if constexpr (requires {
+                         operator co_await(std::forward<Awaitable>(awaitable));
+                       }) {
+    return operator co_await(std::forward<Awaitable>(awaitable));
+  } else {
+    return std::forward<Awaitable>(awaitable);
+  }
+}
+
+}  // namespace internal
+
+/**
+ * \brief A timer for a coroutine that measures both wall time and active time, the time
+ * that the coroutine was not suspended.
+ *
+ * Awaitables that are co_awaited through Await() pause the timer when the coroutine
+ * suspends, and resume it when the coroutine resumes. This costs two clock reads per
+ * suspension. If the awaitable is ready, the coroutine does not suspend and the clock is
+ * not read.
+ *
+ * \code
+ *   CoroutineTimer<> timer(true);
+ *   auto data = co_await timer.Await(socket.Read());
+ *   timer.Stop();
+ * \endcode
+ *
+ * \tparam clock The clock to use.
+ */
+template <typename clock = std::chrono::steady_clock>
+class CoroutineTimer {
+ public:
+  using point = typename clock::time_point;
+
+  /// @brief Construct a new timer. This also starts the timer if start=true.
+  explicit CoroutineTimer(bool start = false) {
+    if (start) Start();
+  }
+
+  /// @brief Start the timer.
+  inline void Start() {
+    start_ = clock::now();
+    resumed_ = start_;
+    active_ = {};
+    suspensions_ = 0;
+  }
+
+  /// @brief Stop the timer.
+  inline void Stop() {
+    stop_ = clock::now();
+    active_ += stop_ - resumed_;
+  }
+
+  /**
+   * \brief Wrap an awaitable, so that the time the coroutine is suspended on it is not
+   * counted as active time.
+   *
+   * The awaitable is stored in the returned awaiter, which must be co_awaited directly.
+   */
+  template <typename Awaitable>
+  auto Await(Awaitable&& awaitable) {
+    return Awaiter<Awaitable>{this, std::forward<Awaitable>(awaitable)};
+  }
+
+  /// @brief Return the wall time in nanoseconds.
+  [[nodiscard]] inline auto nanoseconds() const -> int64_t {
+    return internal::Ticks<typename clock::period>::nanoseconds(
+        static_cast<int64_t>((stop_ - start_).count()));
+  }
+
+  /// @brief Return the active time, the wall time minus the time suspended, in
+  /// nanoseconds.
+  [[nodiscard]] inline auto active_nanoseconds() const -> int64_t {
+    return internal::Ticks<typename clock::period>::nanoseconds(
+        static_cast<int64_t>(active_.count()));
+  }
+
+  /// @brief Return the time suspended in nanoseconds.
+  [[nodiscard]] inline auto suspended_nanoseconds() const -> int64_t {
+    return nanoseconds() - active_nanoseconds();
+  }
+
+  /// @brief Return the wall time in seconds.
+  [[nodiscard]] inline auto seconds() const -> double {
+    return internal::Ticks<typename clock::period>::seconds(
+        static_cast<int64_t>((stop_ - start_).count()));
+  }
+
+  /// @brief Return the active time in seconds.
+  [[nodiscard]] inline auto active_seconds() const -> double {
+    return internal::Ticks<typename clock::period>::seconds(
+        static_cast<int64_t>(active_.count()));
+  }
+
+  /// @brief Return the number of times the coroutine suspended while awaiting.
+  [[nodiscard]] inline auto suspensions() const -> uint64_t { return suspensions_; }
+
+ private:
+  template <typename Awaitable>
+  struct Awaiter {
+    using Inner = decltype(internal::GetAwaiter(std::declval<Awaitable>()));
+
+    auto await_ready() -> bool { return inner.await_ready(); }
+
+    template <typename Promise>
+    auto await_suspend(std::coroutine_handle<Promise> handle) {
+      // Pause before handing the coroutine over, since it may be resumed on another
+      // thread before the inner await_suspend() returns.
+      timer->active_ += clock::now() - timer->resumed_;
+      timer->suspensions_++;
+      suspended = true;
+      return inner.await_suspend(handle);
+    }
+
+    decltype(auto) await_resume() {
+      // If the awaitable was ready, the timer was never paused and keeps running.
+      if (suspended) timer->resumed_ = clock::now();
+      return inner.await_resume();
+    }
+
+    CoroutineTimer* timer;
+    Awaitable awaitable;
+    // A reference to awaitable if it is its own awaiter.
+    Inner inner = internal::GetAwaiter(static_cast<Awaitable&&>(awaitable));
+    bool suspended = false;
+  };
+
+  point start_;
+  point stop_;
+  point resumed_;
+  typename clock::duration active_{};
+  uint64_t suspensions_ = 0;
+};
+
+}  // namespace putong
+
+#endif
@@ -0,0 +1,112 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/// @file
+/// @brief Helpers to query and set the CPUs that threads run on.
+
+namespace putong {
+
+/// @brief Return the ids of the CPUs that this process may run on, in ascending order.
+inline auto OnlineCpus() -> std::vector<int> {
+  std::vector<int> result;
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &set)) result.push_back(cpu);
+    }
+  }
+#endif
+  if (result.empty()) {
+    for (unsigned int cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency());
+         cpu++) {
+      result.push_back(static_cast<int>(cpu));
+    }
+  }
+  return result;
+}
+
+/// @brief Restrict the calling thread to a single CPU. Return true on success.
+inline auto PinThisThread(int cpu) -> bool {
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  (void)cpu;
+  return false;
+#endif
+}
+
+/// @brief Return the CPU the calling thread is running on, or -1 if unknown.
+inline auto CurrentCpu() -> int {
+#if defined(__linux__)
+  return sched_getcpu();
+#else
+  return -1;
+#endif
+}
+
+/// @brief Return the NUMA node of a CPU, or 0 if unknown.
+inline auto NumaNode(int cpu) -> int {
+#if defined(__linux__)
+  char path[64];
+  std::snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+  DIR* dir = opendir(path);
+  if (dir == nullptr) return 0;
+  int node = 0;
+  while (auto* entry = readdir(dir)) {
+    if (std::sscanf(entry->d_name, "node%d", &node) == 1) break;
+    node = 0;
+  }
+  closedir(dir);
+  return node;
+#else
+  (void)cpu;
+  return 0;
+#endif
+}
+
+/**
+ * \brief Return the ids of the CPUs that this process may run on, grouped by NUMA node.
+ *
+ * Threads that are pinned to consecutive CPUs of the result share a node where possible,
+ * so work that is split into contiguous parts over such threads stays node-local.
+ */
+inline auto CpusByNumaNode() -> std::vector<int> {
+  auto cpus = OnlineCpus();
+  std::vector<std::pair<int, int>> nodes;
+  for (int cpu : cpus) nodes.emplace_back(NumaNode(cpu), cpu);
+  std::sort(nodes.begin(), nodes.end());
+  for (size_t i = 0; i < cpus.size(); i++) cpus[i] = nodes[i].second;
+  return cpus;
+}
+
+}  // namespace putong
@@ -0,0 +1,92 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "putong/clock.h"
+#include "putong/timer.h"
+
+// This header is empty unless thread_cpu_clock is available.
+#if defined(__linux__)
+
+namespace putong {
+
+/**
+ * \brief A split timer that measures both wall time and CPU time of the calling thread.
+ *
+ * The ratio of CPU time to wall time of a split shows how much of it the thread was
+ * running: close to one for a stage that computes, and close to zero for a stage that
+ * waits for locks, I/O or a CPU. All calls must be made on the same thread.
+ *
+ * \tparam num_splits The number of splits.
+ * \tparam wall_clock The clock of the wall time.
+ * \tparam cpu_clock The clock of the CPU time.
+ */
+template <unsigned int num_splits = 1, typename wall_clock = std::chrono::steady_clock,
+          typename cpu_clock = thread_cpu_clock>
+struct DualTimer {
+  SplitTimer<num_splits, wall_clock> wall;
+  SplitTimer<num_splits, cpu_clock> cpu;
+
+  /// @brief Construct a new timer. This also starts the timer if start=true.
+  explicit DualTimer(bool start = false) {
+    if (start) Start();
+  }
+
+  /// @brief Start the timer.
+  inline void Start() {
+    cpu.Start();
+    wall.Start();
+  }
+
+  /// @brief Record a split time.
+  inline void Split() {
+    wall.Split();
+    cpu.Split();
+  }
+
+  /// @brief Retrieve the wall time of split interval i in nanoseconds.
+  [[nodiscard]] inline auto wall_nanoseconds(size_t i) const -> int64_t {
+    return wall.nanoseconds(i);
+  }
+
+  /// @brief Retrieve the CPU time of split interval i in nanoseconds.
+  [[nodiscard]] inline auto cpu_nanoseconds(size_t i) const -> int64_t {
+    return cpu.nanoseconds(i);
+  }
+
+  /// @brief Retrieve the ratio of CPU time to wall time of split interval i, or zero if
+  /// the wall time is zero.
+  [[nodiscard]] inline auto ratio(size_t i) const -> double {
+    auto w = wall_nanoseconds(i);
+    if (w <= 0) return 0.0;
+    return static_cast<double>(cpu_nanoseconds(i)) / static_cast<double>(w);
+  }
+
+  /// @brief Retrieve the ratios of CPU time to wall time of all split intervals.
+  [[nodiscard]] inline auto ratios() const -> std::vector<double> {
+    std::vector<double> result;
+    for (size_t i = 0; i < num_splits; i++) result.push_back(ratio(i));
+    return result;
+  }
+};
+
+}  // namespace putong
+
+#endif
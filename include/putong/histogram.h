@@ -0,0 +1,313 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+#include "putong/timer.h"
+
+namespace putong {
+
+/**
+ * \brief A histogram of non-negative integer values, e.g. latencies in nanoseconds.
+ *
+ * Buckets are log-linear: every power of two is split into 32 equally sized sub-buckets,
+ * so that the relative error of a reported percentile is at most 1/32. Values below 64
+ * are counted exactly. All counters are atomic, so any number of threads can record
+ * into and read from a histogram concurrently without locks. Histograms with the same
+ * bucket layout can be merged by adding their counters.
+ */
+class Histogram {
+ public:
+  /// The number of bits of a value that select its sub-bucket.
+  static constexpr int kSubBucketBits = 5;
+  static constexpr size_t kSubBuckets = size_t{1} << kSubBucketBits;
+  /// The number of buckets required to cover all 64-bit values.
+  static constexpr size_t kBuckets = (65 - kSubBucketBits) * kSubBuckets;
+
+  Histogram() = default;
+
+  /// @brief Copy-constructor, taking a relaxed snapshot of the counters of h.
+  Histogram(const Histogram& h) { Merge(h); }
+
+  /// @brief Copy assignment operator, taking a relaxed snapshot of the counters of h.
+  auto operator=(const Histogram& h) -> Histogram& {
+    if (this != &h) {
+      Reset();
+      Merge(h);
+    }
+    return *this;
+  }
+
+  /// @brief Return the index of the bucket that counts value.
+  static constexpr auto BucketIndex(uint64_t value) -> size_t {
+    if (value < 2 * kSubBuckets) return static_cast<size_t>(value);
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - kSubBucketBits;
+    return (static_cast<size_t>(shift) << kSubBucketBits) + (value >> shift);
+  }
+
+  /// @brief Return the smallest value counted by bucket i.
+  static constexpr auto BucketLower(size_t i) -> uint64_t {
+    if (i < 2 * kSubBuckets) return i;
+    auto shift = (i >> kSubBucketBits) - 1;
+    return (uint64_t{kSubBuckets} + (i & (kSubBuckets - 1))) << shift;
+  }
+
+  /// @brief Return the largest value counted by bucket i.
+  static constexpr auto BucketUpper(size_t i) -> uint64_t {
+    return i + 1 == kBuckets ? std::numeric_limits<uint64_t>::max()
+                             : BucketLower(i + 1) - 1;
+  }
+
+  /// @brief Record n occurrences of a value. Negative values are recorded as zero.
+  inline void Record(int64_t value, uint64_t n = 1) {
+    auto v = static_cast<uint64_t>(std::max<int64_t>(value, 0));
+    buckets_[BucketIndex(v)].fetch_add(n, std::memory_order_relaxed);
+    count_.fetch_add(n, std::memory_order_relaxed);
+    sum_.fetch_add(v * n, std::memory_order_relaxed);
+    auto min = min_.load(std::memory_order_relaxed);
+    while (v < min && !min_.compare_exchange_weak(min, v, std::memory_order_relaxed)) {
+    }
+    auto max = max_.load(std::memory_order_relaxed);
+    while (v > max && !max_.compare_exchange_weak(max, v, std::memory_order_relaxed)) {
+    }
+  }
+
+  /// @brief Record the interval of a stopped timer in nanoseconds.
+  template <typename clock>
+  inline void Record(const Timer<clock>& timer) {
+    Record(timer.nanoseconds());
+  }
+
+  /// @brief Add the counters of another histogram to this histogram.
+  void Merge(const Histogram& h) {
+    for (size_t i = 0; i < kBuckets; i++) {
+      auto c = h.buckets_[i].load(std::memory_order_relaxed);
+      if (c != 0) buckets_[i].fetch_add(c, std::memory_order_relaxed);
+    }
+    count_.fetch_add(h.count(), std::memory_order_relaxed);
+    sum_.fetch_add(h.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    auto hmin = h.min_.load(std::memory_order_relaxed);
+    auto min = min_.load(std::memory_order_relaxed);
+    while (hmin < min &&
+           !min_.compare_exchange_weak(min, hmin, std::memory_order_relaxed)) {
+    }
+    auto hmax = h.max_.load(std::memory_order_relaxed);
+    auto max = max_.load(std::memory_order_relaxed);
+    while (hmax > max &&
+           !max_.compare_exchange_weak(max, hmax, std::memory_order_relaxed)) {
+    }
+  }
+
+  /// @brief Reset all counters. Values recorded concurrently may be partially lost.
+  void Reset() {
+    for (auto& b : buckets_) b.store(0, std::memory_order_relaxed);
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    min_.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+  }
+
+  /// @brief Return the number of recorded values.
+  [[nodiscard]] auto count() const -> uint64_t {
+    return count_.load(std::memory_order_relaxed);
+  }
+
+  /// @brief Return the exact sum of all recorded values.
+  [[nodiscard]] auto sum() const -> int64_t {
+    return static_cast<int64_t>(sum_.load(std::memory_order_relaxed));
+  }
+
+  /// @brief Return the exact smallest recorded value, or zero if the histogram is empty.
+  [[nodiscard]] auto min() const -> int64_t {
+    return count() == 0 ? 0 : static_cast<int64_t>(min_.load(std::memory_order_relaxed));
+  }
+
+  /// @brief Return the exact largest recorded value, or zero if the histogram is empty.
+  [[nodiscard]] auto max() const -> int64_t {
+    return static_cast<int64_t>(max_.load(std::memory_order_relaxed));
+  }
+
+  /// @brief Return the mean of all recorded values, or zero if the histogram is empty.
+  [[nodiscard]] auto mean() const -> double {
+    auto n = count();
+    return n == 0 ? 0.0 : static_cast<double>(sum()) / static_cast<double>(n);
+  }
+
+  /// @brief Return the number of values counted by bucket i.
+  [[nodiscard]] auto bucket(size_t i) const -> uint64_t {
+    return buckets_[i].load(std::memory_order_relaxed);
+  }
+
+  /**
+   * \brief Return the value below or at which the given percentage of values lie.
+   *
+   * The result is the largest value of the bucket that contains the percentile, limited
+   * to the exact minimum and maximum.
+   *
+   * \param percentile The percentile, between 0 and 100.
+   * \return The percentile, or zero if the histogram is empty.
+   */
+  [[nodiscard]] auto Percentile(double percentile) const -> int64_t {
+    auto n = count();
+    if (n == 0) return 0;
+    auto p = std::clamp(percentile, 0.0, 100.0) / 100.0;
+    auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p * n)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; i++) {
+      seen += bucket(i);
+      if (seen >= rank) {
+        auto upper = static_cast<int64_t>(std::min<uint64_t>(BucketUpper(i), INT64_MAX));
+        return std::clamp(upper, min(), max());
+      }
+    }
+    return max();
+  }
+
+ private:
+  std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+  std::atomic<uint64_t> count_ = 0;
+  std::atomic<uint64_t> sum_ = 0;
+  std::atomic<uint64_t> min_ = std::numeric_limits<uint64_t>::max();
+  std::atomic<uint64_t> max_ = 0;
+};
+
+/**
+ * \brief A histogram over a sliding time window, e.g. for the 99th percentile latency
+ * of the last ten seconds.
+ *
+ * Time is divided into buckets of a fixed width. Every bucket has its own Histogram, and
+ * the histograms are kept in a ring with one spare slot, so memory is constant. Values
+ * are recorded into the histogram of the current bucket without locks. Rotating to the
+ * next bucket is done by the first writer that observes it, which clears the slot of
+ * the bucket after it, so that slot is already empty when writers reach it. Readers
+ * merge the histograms of the last buckets on demand.
+ *
+ * A value recorded while another thread rotates may be attributed to the previous
+ * bucket, or be lost if the window was idle for longer than its length.
+ *
+ * \tparam clock The clock that determines the current bucket.
+ */
+template <typename clock = std::chrono::steady_clock>
+class RollingHistogram {
+ public:
+  using duration = typename clock::duration;
+  using time_point = typename clock::time_point;
+
+  /**
+   * \brief Construct a rolling histogram.
+   * \param width The width of a bucket.
+   * \param buckets The number of buckets in the window.
+   */
+  explicit RollingHistogram(duration width = std::chrono::seconds(1), size_t buckets = 10)
+      : width_(width),
+        buckets_(std::max<size_t>(buckets, 1)),
+        slots_(std::make_unique<Histogram[]>(buckets_ + 1)) {}
+
+  /// @brief Return the width of a bucket.
+  [[nodiscard]] auto width() const -> duration { return width_; }
+
+  /// @brief Return the number of buckets in the window.
+  [[nodiscard]] auto buckets() const -> size_t { return buckets_; }
+
+  /// @brief Record a value at the given time.
+  inline void Record(int64_t value, time_point now) {
+    auto epoch = Epoch(now);
+    if (epoch > current_.load(std::memory_order_acquire)) Rotate(epoch);
+    slots_[Slot(current_.load(std::memory_order_acquire))].Record(value);
+  }
+
+  /// @brief Record a value at the current time.
+  inline void Record(int64_t value) { Record(value, clock::now()); }
+
+  /// @brief Record the interval of a stopped timer in nanoseconds, at the current time.
+  template <typename timer_clock>
+  inline void Record(const Timer<timer_clock>& timer) {
+    Record(timer.nanoseconds());
+  }
+
+  /**
+   * \brief Merge the histograms of the last buckets of the window.
+   *
+   * \param now The time at which the window ends.
+   * \param last The number of buckets to merge, at most buckets(). The current bucket,
+   *             which is only partially filled, counts as one.
+   * \return The merged histogram.
+   */
+  [[nodiscard]] auto Snapshot(time_point now, size_t last) const -> Histogram {
+    Histogram result;
+    auto current = current_.load(std::memory_order_acquire);
+    auto end = std::max(Epoch(now), current);
+    auto n = static_cast<int64_t>(std::min(last, buckets_));
+    for (auto e = std::max(end - n + 1, current - static_cast<int64_t>(buckets_) + 1);
+         e <= current; e++) {
+      result.Merge(slots_[Slot(e)]);
+    }
+    return result;
+  }
+
+  /// @brief Merge the histograms of the last buckets of the window ending now.
+  [[nodiscard]] auto Snapshot(size_t last) const -> Histogram {
+    return Snapshot(clock::now(), last);
+  }
+
+  /// @brief Merge the histograms of all buckets of the window ending now.
+  [[nodiscard]] auto Snapshot() const -> Histogram { return Snapshot(buckets_); }
+
+ private:
+  [[nodiscard]] auto Epoch(time_point t) const -> int64_t {
+    return static_cast<int64_t>(t.time_since_epoch() / width_);
+  }
+
+  [[nodiscard]] auto Slot(int64_t epoch) const -> size_t {
+    auto n = static_cast<int64_t>(buckets_ + 1);
+    return static_cast<size_t>(((epoch % n) + n) % n);
+  }
+
+  /// Rotate to bucket epoch, unless another thread is already rotating.
+  void Rotate(int64_t epoch) {
+    if (rotating_.exchange(true, std::memory_order_acquire)) return;
+    // Re-check, since another thread may have rotated in the meantime.
+    auto now = current_.load(std::memory_order_relaxed);
+    if (now >= epoch) {
+      rotating_.store(false, std::memory_order_release);
+      return;
+    }
+    // Bucket now + 1 was cleared by the previous rotation. Clear the following buckets
+    // up to and including the one after epoch, but at most every slot once.
+    auto clear = std::min<int64_t>(epoch - now, static_cast<int64_t>(buckets_ + 1));
+    for (int64_t e = epoch + 1; e > epoch + 1 - clear; e--) slots_[Slot(e)].Reset();
+    current_.store(epoch, std::memory_order_release);
+    rotating_.store(false, std::memory_order_release);
+  }
+
+  duration width_;
+  size_t buckets_;
+  std::unique_ptr<Histogram[]> slots_;
+  /// The current bucket. Starts far in the past, so the first value always rotates.
+  std::atomic<int64_t> current_ = std::numeric_limits<int64_t>::min() / 2;
+  std::atomic<bool> rotating_ = false;
+};
+
+}  // namespace putong
@@ -0,0 +1,194 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+
+namespace putong {
+
+namespace internal {
+
+/// @brief An immutable, heap-allocated string owned by an InternPool.
+struct InternNode {
+  const InternNode* next;
+  size_t hash;
+  size_t size;
+  char data[1];
+
+  static auto Create(std::string_view str, size_t hash) -> InternNode* {
+    void* mem = ::operator new(offsetof(InternNode, data) + str.size() + 1);
+    auto* node = static_cast<InternNode*>(mem);
+    node->next = nullptr;
+    node->hash = hash;
+    node->size = str.size();
+    std::memcpy(node->data, str.data(), str.size());
+    node->data[str.size()] = '\0';
+    return node;
+  }
+
+  static void Destroy(const InternNode* node) {
+    ::operator delete(const_cast<InternNode*>(node));
+  }
+};
+
+}  // namespace internal
+
+/**
+ * \brief A handle to an immutable string stored in an InternPool.
+ *
+ * Handles are a single pointer. Copying one never allocates or touches a reference count,
+ * and two handles from the same pool compare equal iff they refer to equal strings.
+ */
+class InternedString {
+ public:
+  /// @brief Construct a handle to the empty string.
+  InternedString() = default;
+
+  [[nodiscard]] auto view() const -> std::string_view {
+    if (node_ == nullptr) return {};
+    return {node_->data, node_->size};
+  }
+  [[nodiscard]] auto str() const -> std::string { return std::string(view()); }
+  [[nodiscard]] auto c_str() const -> const char* {
+    return node_ == nullptr ? "" : node_->data;
+  }
+  [[nodiscard]] auto size() const -> size_t { return node_ == nullptr ? 0 : node_->size; }
+  [[nodiscard]] auto empty() const -> bool { return size() == 0; }
+
+  friend auto operator==(InternedString a, InternedString b) -> bool {
+    return a.node_ == b.node_;
+  }
+  friend auto operator!=(InternedString a, InternedString b) -> bool {
+    return a.node_ != b.node_;
+  }
+
+ private:
+  friend class InternPool;
+  explicit InternedString(const internal::InternNode* node) : node_(node) {}
+
+  const internal::InternNode* node_ = nullptr;
+};
+
+/**
+ * \brief A lock-free pool of deduplicated, immutable strings.
+ *
+ * The pool is a fixed array of buckets, each holding a singly-linked list that only ever
+ * grows at its head through a compare-and-swap. Lookups of strings that are already
+ * interned never allocate and never block. Strings are never removed, so the pool should
+ * only be used for messages drawn from a bounded set, such as error messages.
+ */
+class InternPool {
+ public:
+  static constexpr size_t kDefaultBuckets = 4096;
+
+  /// @brief Construct a new pool. The number of buckets is rounded up to a power of two.
+  explicit InternPool(size_t num_buckets = kDefaultBuckets) {
+    size_t n = 1;
+    while (n < num_buckets) n <<= 1;
+    mask_ = n - 1;
+    buckets_ = std::make_unique<std::atomic<const internal::InternNode*>[]>(n);
+    for (size_t i = 0; i < n; i++) {
+      buckets_[i].store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  InternPool(const InternPool&) = delete;
+  auto operator=(const InternPool&) -> InternPool& = delete;
+
+  ~InternPool() {
+    for (size_t i = 0; i <= mask_; i++) {
+      auto* node = buckets_[i].load(std::memory_order_acquire);
+      while (node != nullptr) {
+        auto* next = node->next;
+        internal::InternNode::Destroy(node);
+        node = next;
+      }
+    }
+  }
+
+  /**
+   * \brief Return the process-wide pool.
+   *
+   * The global pool is intentionally never destroyed, so handles held by objects with
+   * static storage duration remain valid during program exit.
+   */
+  static auto Global() -> InternPool& {
+    static auto* pool = new InternPool();
+    return *pool;
+  }
+
+  /// @brief Return a handle to a string equal to str, inserting it if required.
+  auto Intern(std::string_view str) -> InternedString {
+    if (str.empty()) return InternedString();
+
+    const size_t hash = std::hash<std::string_view>{}(str);
+    auto& bucket = buckets_[hash & mask_];
+    auto* head = bucket.load(std::memory_order_acquire);
+    if (auto* found = Find(head, nullptr, str, hash)) return InternedString(found);
+
+    internal::InternNode* node = internal::InternNode::Create(str, hash);
+    for (;;) {
+      node->next = head;
+      auto* expected = head;
+      if (bucket.compare_exchange_weak(expected, node, std::memory_order_release,
+                                       std::memory_order_acquire)) {
+        size_.fetch_add(1, std::memory_order_relaxed);
+        bytes_.fetch_add(str.size(), std::memory_order_relaxed);
+        return InternedString(node);
+      }
+      // Another thread pushed onto this bucket. Only the new nodes need to be checked.
+      if (auto* found = Find(expected, head, str, hash)) {
+        internal::InternNode::Destroy(node);
+        return InternedString(found);
+      }
+      head = expected;
+    }
+  }
+
+  /// @brief Return the number of distinct strings in the pool.
+  [[nodiscard]] auto size() const -> size_t {
+    return size_.load(std::memory_order_relaxed);
+  }
+
+  /// @brief Return the number of characters stored in the pool.
+  [[nodiscard]] auto bytes() const -> size_t {
+    return bytes_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  /// @brief Search the list from first up to (excluding) last for str.
+  static auto Find(const internal::InternNode* first, const internal::InternNode* last,
+                   std::string_view str, size_t hash) -> const internal::InternNode* {
+    for (auto* node = first; node != last; node = node->next) {
+      if (node->hash == hash && std::string_view(node->data, node->size) == str) {
+        return node;
+      }
+    }
+    return nullptr;
+  }
+
+  size_t mask_ = 0;
+  std::unique_ptr<std::atomic<const internal::InternNode*>[]> buckets_;
+  std::atomic<size_t> size_ = 0;
+  std::atomic<size_t> bytes_ = 0;
+};
+
+}  // namespace putong
@@ -0,0 +1,232 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "putong/sync.h"
+#include "putong/timer.h"
+
+namespace putong {
+
+namespace internal {
+
+/// @brief An exponentially weighted moving average, updated once per tick.
+struct Ewma {
+  /// @brief Construct an average over a window of the given number of minutes.
+  explicit Ewma(double minutes, double tick_seconds)
+      : alpha(1.0 - std::exp(-tick_seconds / (60.0 * minutes))) {}
+
+  /// @brief Apply n ticks during each of which the value x was observed.
+  void Update(double x, int64_t n) {
+    if (n <= 0) return;
+    if (!initialized) {
+      value = x;
+      initialized = true;
+      n--;
+    }
+    // Closed form of n successive updates value += alpha * (x - value).
+    value = x + (value - x) * std::pow(1.0 - alpha, static_cast<double>(n));
+  }
+
+  double alpha;
+  double value = 0.0;
+  bool initialized = false;
+};
+
+/// @brief A set of counters that threads add to without sharing cache lines.
+template <size_t num_stripes>
+struct StripedCounter {
+  static_assert((num_stripes & (num_stripes - 1)) == 0);
+
+  inline void Add(uint64_t n) {
+    stripes[ThreadStripe() & (num_stripes - 1)].value.fetch_add(
+        n, std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] auto Sum() const -> uint64_t {
+    uint64_t result = 0;
+    for (const auto& s : stripes) result += s.value.load(std::memory_order_relaxed);
+    return result;
+  }
+
+  std::array<Padded<std::atomic<uint64_t>>, num_stripes> stripes{};
+};
+
+/**
+ * \brief The decay state shared by Meter and EwmaTimer.
+ *
+ * Writers never tick. Instead, readers apply all ticks that have passed since the last
+ * read, attributing the events of that period evenly to its ticks. Averages are
+ * therefore exact if they are read at least once per tick, and otherwise approximate
+ * the arrival pattern within the unread period as uniform.
+ */
+template <typename clock>
+struct Decay {
+  static constexpr auto kTick = std::chrono::seconds(5);
+
+  /// @brief Return the number of ticks passed since the last call, and advance.
+  auto Advance(typename clock::time_point now) -> int64_t {
+    auto n = static_cast<int64_t>((now - last) / kTick);
+    if (n > 0) last += n * kTick;
+    return n;
+  }
+
+  std::mutex mutex;
+  typename clock::time_point last = clock::now();
+  std::array<Ewma, 3> averages = {Ewma(1, 5), Ewma(5, 5), Ewma(15, 5)};
+};
+
+}  // namespace internal
+
+/**
+ * \brief A meter of the rate of events, with 1, 5 and 15 minute moving averages.
+ *
+ * Events are counted in per-thread stripes with a relaxed atomic addition, so marking
+ * does not contend between threads and does not read the clock. The moving averages
+ * decay every five seconds, lazily, when they are read.
+ *
+ * \tparam clock The clock that determines the ticks of the moving averages.
+ */
+template <typename clock = std::chrono::steady_clock>
+class Meter {
+ public:
+  static constexpr size_t kStripes = 16;
+
+  Meter() = default;
+
+  /// @brief Mark the occurrence of n events.
+  inline void Mark(uint64_t n = 1) { count_.Add(n); }
+
+  /// @brief Return the number of marked events.
+  [[nodiscard]] auto count() const -> uint64_t { return count_.Sum(); }
+
+  /// @brief Return the mean rate since construction in events per second.
+  [[nodiscard]] auto mean_rate() const -> double {
+    std::chrono::duration<double> elapsed = clock::now() - start_;
+    return elapsed.count() <= 0 ? 0.0 : static_cast<double>(count()) / elapsed.count();
+  }
+
+  /// @brief Return the one-minute moving average in events per second.
+  auto rate1() -> double { return Rate(0); }
+  /// @brief Return the five-minute moving average in events per second.
+  auto rate5() -> double { return Rate(1); }
+  /// @brief Return the fifteen-minute moving average in events per second.
+  auto rate15() -> double { return Rate(2); }
+
+ private:
+  auto Rate(size_t i) -> double {
+    std::lock_guard<std::mutex> lock(decay_.mutex);
+    auto ticks = decay_.Advance(clock::now());
+    if (ticks > 0) {
+      auto total = count();
+      double per_tick = static_cast<double>(total - ticked_) / static_cast<double>(ticks);
+      double per_second = per_tick / std::chrono::duration<double>(decay_.kTick).count();
+      for (auto& a : decay_.averages) a.Update(per_second, ticks);
+      ticked_ = total;
+    }
+    return decay_.averages[i].value;
+  }
+
+  internal::StripedCounter<kStripes> count_;
+  typename clock::time_point start_ = clock::now();
+  internal::Decay<clock> decay_;
+  uint64_t ticked_ = 0;
+};
+
+/**
+ * \brief A moving average of the latency of timed events, with a Meter of their rate.
+ *
+ * The latency averages are 1, 5 and 15 minute moving averages of the mean latency per
+ * five-second tick, in nanoseconds. Ticks without events leave the averages unchanged.
+ * Like Meter, recording only adds to per-thread stripes.
+ *
+ * \tparam clock The clock that determines the ticks of the moving averages.
+ */
+template <typename clock = std::chrono::steady_clock>
+class EwmaTimer {
+ public:
+  static constexpr size_t kStripes = Meter<clock>::kStripes;
+
+  EwmaTimer() = default;
+
+  /// @brief Record the latency of one event in nanoseconds.
+  inline void Record(int64_t nanoseconds) {
+    meter_.Mark();
+    sum_.Add(static_cast<uint64_t>(nanoseconds < 0 ? 0 : nanoseconds));
+  }
+
+  /// @brief Record the interval of a stopped timer.
+  template <typename timer_clock>
+  inline void Record(const Timer<timer_clock>& timer) {
+    Record(timer.nanoseconds());
+  }
+
+  /// @brief Return the number of recorded events.
+  [[nodiscard]] auto count() const -> uint64_t { return meter_.count(); }
+
+  /// @brief Return the sum of all recorded latencies in nanoseconds.
+  [[nodiscard]] auto sum() const -> int64_t { return static_cast<int64_t>(sum_.Sum()); }
+
+  /// @brief Return the mean of all recorded latencies in nanoseconds.
+  [[nodiscard]] auto mean() const -> double {
+    auto n = count();
+    return n == 0 ? 0.0 : static_cast<double>(sum()) / static_cast<double>(n);
+  }
+
+  /// @brief Return the one-minute moving average latency in nanoseconds.
+  auto mean1() -> double { return Mean(0); }
+  /// @brief Return the five-minute moving average latency in nanoseconds.
+  auto mean5() -> double { return Mean(1); }
+  /// @brief Return the fifteen-minute moving average latency in nanoseconds.
+  auto mean15() -> double { return Mean(2); }
+
+  /// @brief Return the meter of the rate of recorded events.
+  auto meter() -> Meter<clock>& { return meter_; }
+
+ private:
+  auto Mean(size_t i) -> double {
+    std::lock_guard<std::mutex> lock(decay_.mutex);
+    auto ticks = decay_.Advance(clock::now());
+    if (ticks > 0) {
+      // Events recorded concurrently may be split over two ticks, which only shifts
+      // their weight between the means of these ticks.
+      auto sum = sum_.Sum();
+      auto count = meter_.count();
+      if (count > ticked_count_) {
+        double mean = static_cast<double>(sum - ticked_sum_) /
+                      static_cast<double>(count - ticked_count_);
+        for (auto& a : decay_.averages) a.Update(mean, ticks);
+        ticked_sum_ = sum;
+        ticked_count_ = count;
+      }
+    }
+    return decay_.averages[i].value;
+  }
+
+  Meter<clock> meter_;
+  internal::StripedCounter<kStripes> sum_;
+  internal::Decay<clock> decay_;
+  uint64_t ticked_sum_ = 0;
+  uint64_t ticked_count_ = 0;
+};
+
+}  // namespace putong
@@ -0,0 +1,241 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+#include "putong/cache_line.h"
+
+namespace putong {
+
+/**
+ * \brief A pool of objects of type T, with O(1) construction and destruction that does
+ * not allocate after warm-up.
+ *
+ * Slots are stored in chunks that double in size and are never freed while the pool
+ * exists. Every slot has a 32-bit index. Free slots are kept in a small cache per thread
+ * and, beyond that, in a shared lock-free list. The head of the shared list packs the
+ * index of the first slot with a tag that is incremented by every update, so a head
+ * that was popped and pushed again in between does not compare equal (ABA).
+ *
+ * The thread caches are shared by all pools of the same type T. A cache is flushed to
+ * its pool when the thread uses another pool of the same type, or when the thread
+ * exits, so threads should preferably use a single pool per type.
+ */
+template <typename T>
+class ObjectPool {
+ public:
+  /// @brief The maximum number of free slots in the cache of a thread.
+  static constexpr size_t kCacheSize = 64;
+
+  ObjectPool() : core_(std::make_shared<Core>()) {}
+  ObjectPool(const ObjectPool&) = delete;
+  auto operator=(const ObjectPool&) -> ObjectPool& = delete;
+
+  /// @brief Return the process-wide pool of T, which is never destroyed.
+  static auto Global() -> ObjectPool& {
+    static auto* pool = new ObjectPool();
+    return *pool;
+  }
+
+  /**
+   * \brief Construct an object in a free slot. Return nullptr if out of memory.
+   *
+   * If the constructor of T throws, the slot is returned to the pool and the exception
+   * is propagated.
+   */
+  template <typename... Args>
+  auto Make(Args&&... args) -> T* {
+    auto& cache = Cache::Get(core_);
+    if (cache.size == 0 && !cache.Refill()) return nullptr;
+    auto* slot = cache.slots[--cache.size];
+    try {
+      return new (slot->storage) T(std::forward<Args>(args)...);
+    } catch (...) {
+      Release(slot);
+      throw;
+    }
+  }
+
+  /// @brief Destroy an object made by this pool and return its slot to the pool.
+  void Delete(T* object) {
+    if (object == nullptr) return;
+    object->~T();
+    Release(reinterpret_cast<Slot*>(object));
+  }
+
+  /// @brief Return the number of slots the pool has allocated.
+  [[nodiscard]] auto capacity() const -> size_t {
+    return core_->capacity.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Slot {
+    // The storage must be the first member, so that objects convert back to slots.
+    alignas(T) unsigned char storage[sizeof(T)];
+    uint32_t index;
+    std::atomic<uint32_t> next;
+  };
+
+  /// Return a free slot to the cache of the calling thread. The cache is looked up
+  /// again, since a constructor or destructor of T may have used another pool.
+  void Release(Slot* slot) {
+    auto& cache = Cache::Get(core_);
+    if (cache.size == kCacheSize) cache.Flush(kCacheSize / 2);
+    cache.slots[cache.size++] = slot;
+  }
+
+  /// The shared state, which lives until the pool and all caches holding slots are gone.
+  struct Core {
+    static constexpr uint32_t kFirstChunkBits = 6;
+    static constexpr uint32_t kMaxChunks = 32 - kFirstChunkBits;
+    static constexpr uint32_t kEmpty = 0;
+
+    ~Core() {
+      for (auto& c : chunks) delete[] c.load(std::memory_order_relaxed);
+    }
+
+    /// Return the chunk that holds the slot with an index.
+    static auto ChunkOf(uint32_t index) -> uint32_t {
+      return 31 - __builtin_clz(index + (1u << kFirstChunkBits)) - kFirstChunkBits;
+    }
+
+    /// Return the number of slots of a chunk. The first slot of chunk c has index
+    /// ChunkSize(c) - ChunkSize(0).
+    static auto ChunkSize(uint32_t chunk) -> uint32_t {
+      return (1u << kFirstChunkBits) << chunk;
+    }
+
+    auto slot(uint32_t index) -> Slot* {
+      auto chunk = ChunkOf(index);
+      auto* base = chunks[chunk].load(std::memory_order_acquire);
+      return base + (index + ChunkSize(0) - ChunkSize(chunk));
+    }
+
+    /// Reserve n fresh slots, allocating chunks as required. Return the first index.
+    /// Threads that need the same missing chunk both allocate it, and all but the one
+    /// that installs it free their copy, so growing the pool does not need a lock.
+    auto Reserve(uint32_t n, uint32_t* first) -> bool {
+      auto start = next_unused.fetch_add(n, std::memory_order_relaxed);
+      if (start > UINT32_MAX - n - (1u << kFirstChunkBits)) return false;
+      for (auto c = ChunkOf(start); c <= ChunkOf(start + n - 1); c++) {
+        if (chunks[c].load(std::memory_order_acquire) != nullptr) continue;
+        auto size = ChunkSize(c);
+        auto* chunk = new (std::nothrow) Slot[size];
+        if (chunk == nullptr) return false;
+        for (uint32_t i = 0; i < size; i++) {
+          chunk[i].index = size - ChunkSize(0) + i;
+        }
+        Slot* expected = nullptr;
+        if (chunks[c].compare_exchange_strong(expected, chunk, std::memory_order_acq_rel,
+                                              std::memory_order_acquire)) {
+          capacity.fetch_add(size, std::memory_order_relaxed);
+        } else {
+          delete[] chunk;
+        }
+      }
+      *first = start;
+      return true;
+    }
+
+    /// Push a chain of slots linked through their next members onto the shared list.
+    void Push(Slot* first, Slot* last) {
+      auto head = free.load(std::memory_order_relaxed);
+      do {
+        last->next.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+      } while (!free.compare_exchange_weak(head, Pack(first->index + 1, head),
+                                           std::memory_order_release,
+                                           std::memory_order_relaxed));
+    }
+
+    /// Pop a slot from the shared list, or return nullptr if it is empty.
+    auto Pop() -> Slot* {
+      auto head = free.load(std::memory_order_acquire);
+      while (static_cast<uint32_t>(head) != kEmpty) {
+        auto* s = slot(static_cast<uint32_t>(head) - 1);
+        auto next = s->next.load(std::memory_order_relaxed);
+        if (free.compare_exchange_weak(head, Pack(next, head), std::memory_order_acquire,
+                                       std::memory_order_acquire)) {
+          return s;
+        }
+      }
+      return nullptr;
+    }
+
+    /// Combine one plus a slot index with the incremented tag of the old head.
+    static auto Pack(uint32_t index, uint64_t old) -> uint64_t {
+      return (((old >> 32) + 1) << 32) | index;
+    }
+
+    /// The shared free list: a tag in the upper and one plus a slot index in the lower
+    /// half, or zero in the lower half if the list is empty.
+    alignas(kCacheLineSize) std::atomic<uint64_t> free = 0;
+    alignas(kCacheLineSize) std::atomic<uint32_t> next_unused = 0;
+    std::atomic<uint32_t> capacity = 0;
+    std::atomic<Slot*> chunks[kMaxChunks]{};
+  };
+
+  /// The free slots cached by a thread, for the pool that it used last.
+  struct Cache {
+    static auto Get(const std::shared_ptr<Core>& core) -> Cache& {
+      auto& cache = cache_;
+      if (cache.core != core) {
+        cache.Flush(cache.size);
+        cache.core = core;
+      }
+      return cache;
+    }
+
+    ~Cache() { Flush(size); }
+
+    auto Refill() -> bool {
+      for (; size < kCacheSize / 2; size++) {
+        auto* s = core->Pop();
+        if (s == nullptr) break;
+        slots[size] = s;
+      }
+      if (size > 0) return true;
+      uint32_t first = 0;
+      if (!core->Reserve(kCacheSize / 2, &first)) return false;
+      for (uint32_t i = 0; i < kCacheSize / 2; i++) slots[size++] = core->slot(first + i);
+      return true;
+    }
+
+    /// Return the n slots on top of the cache to the shared list with a single push.
+    void Flush(size_t n) {
+      if (n == 0 || core == nullptr) return;
+      auto* first = slots[size - n];
+      for (size_t i = size - n; i + 1 < size; i++) {
+        slots[i]->next.store(slots[i + 1]->index + 1, std::memory_order_relaxed);
+      }
+      core->Push(first, slots[size - 1]);
+      size -= n;
+    }
+
+    std::shared_ptr<Core> core;
+    Slot* slots[kCacheSize]{};
+    size_t size = 0;
+  };
+
+  std::shared_ptr<Core> core_;
+  static inline thread_local Cache cache_;
+};
+
+}  // namespace putong
@@ -0,0 +1,238 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "putong/sync.h"
+#include "putong/thread_pool.h"
+#include "putong/timer.h"
+
+namespace putong {
+
+/// @brief A half-open range of indices [begin, end).
+struct Range {
+  size_t begin = 0;
+  size_t end = 0;
+
+  [[nodiscard]] auto size() const -> size_t { return end > begin ? end - begin : 0; }
+};
+
+/// @brief Options of parallel_for() and parallel_reduce().
+struct ParallelOptions {
+  /// The pool to run on, or nullptr for ThreadPool::Global().
+  ThreadPool* pool = nullptr;
+  /**
+   * Place the range on the workers in contiguous parts, part i on worker i, so that
+   * repeated loops over the same range touch the same data from the same worker. The
+   * workers of ThreadPool::Global() are pinned to CpusByNumaNode(), so the parts stay on
+   * the NUMA node where the data was first touched. A pool that is started with a number
+   * of workers is not pinned, and only keeps the parts on the same threads. Stealing
+   * still balances the load.
+   */
+  bool affinity = false;
+};
+
+namespace internal {
+
+/// @brief The body of parallel_for(), which has no per-task state.
+template <typename F>
+struct ForBody {
+  struct Local {};
+
+  auto MakeLocal() -> Local { return {}; }
+  void Chunk(Local& /*local*/, Range chunk) { fn(chunk); }
+  void Finish(Local& /*local*/) {}
+
+  F& fn;
+};
+
+/// @brief The body of parallel_reduce(), which reduces per task and then per loop.
+template <typename T, typename Map, typename Combine>
+struct ReduceBody {
+  using Local = T;
+
+  auto MakeLocal() -> Local { return identity; }
+  void Chunk(Local& local, Range chunk) { local = combine(std::move(local), map(chunk)); }
+  void Finish(Local& local) {
+    std::lock_guard<std::mutex> lock(mutex);
+    result = combine(std::move(result), std::move(local));
+  }
+
+  const T& identity;
+  Map& map;
+  Combine& combine;
+  T result;
+  std::mutex mutex;
+};
+
+/**
+ * \brief The state of a parallel loop, which lives on the stack of the calling thread.
+ *
+ * Tasks use lazy binary splitting: a task runs its range one grain at a time, and before
+ * every grain splits off the upper half of what remains as a new task if the deque of
+ * its worker is empty, i.e. when all work it split off before has been stolen. This
+ * creates parallelism only when other workers ask for it.
+ */
+template <typename Body, typename Hook>
+class ParallelLoop {
+ public:
+  ParallelLoop(ThreadPool* pool, size_t grain, size_t items, Body* body, Hook* hook)
+      : pool_(pool), grain_(grain), body_(body), hook_(hook), remaining_(items) {}
+
+  /// @brief Run the loop over a range and return when all of it is done.
+  void Run(Range range, bool affinity) {
+    if (affinity && pool_->size() > 1) {
+      auto parts = pool_->size();
+      auto part = (range.size() + parts - 1) / parts;
+      for (size_t i = 0; i < parts && range.begin + i * part < range.end; i++) {
+        auto begin = range.begin + i * part;
+        Range r{begin, std::min(range.end, begin + part)};
+        if (!pool_->SubmitTo(i, [this, r] { RunTask(r, true); }).ok()) RunTask(r, false);
+      }
+    } else if (!pool_->Submit([this, range] { RunTask(range, true); }).ok()) {
+      RunTask(range, false);
+    }
+    Wait();
+  }
+
+ private:
+  void RunTask(Range r, bool split) {
+    if (hook_ != nullptr && !started_.load(std::memory_order_relaxed) &&
+        !started_.exchange(true, std::memory_order_relaxed)) {
+      hook_->Split();
+    }
+    auto local = body_->MakeLocal();
+    size_t done = 0;
+    while (r.size() > 0) {
+      while (split && r.size() > 2 * grain_ && pool_->local_backlog() == 0) {
+        Range upper{r.begin + r.size() / 2, r.end};
+        if (!pool_->Submit([this, upper] { RunTask(upper, true); }).ok()) {
+          split = false;
+          break;
+        }
+        r.end = upper.begin;
+      }
+      Range chunk{r.begin, r.begin + std::min(grain_, r.size())};
+      body_->Chunk(local, chunk);
+      done += chunk.size();
+      r.begin = chunk.end;
+    }
+    body_->Finish(local);
+    // This loop may return as soon as the last part is done, so nothing of it may be
+    // touched after that, except for the futex word in the wake-up call.
+    if (remaining_.fetch_sub(done, std::memory_order_acq_rel) == done) {
+      if (hook_ != nullptr) hook_->Split();
+      finished_.store(1, std::memory_order_release);
+      FutexWake(&finished_, 1);
+    }
+  }
+
+  /// Wait for the last part. A worker helps to run tasks, so that nested loops cannot
+  /// block all workers. Other threads spin briefly and then sleep on a futex.
+  void Wait() {
+    bool worker = pool_->worker_index() >= 0;
+    for (int i = 0; finished_.load(std::memory_order_acquire) == 0; i++) {
+      if (worker) {
+        if (!pool_->TryRunOne()) std::this_thread::yield();
+      } else if (i < ThreadPool::kSpins) {
+        CpuRelax();
+      } else {
+        FutexWait(&finished_, 0);
+      }
+    }
+    if (hook_ != nullptr) hook_->Split();
+  }
+
+  ThreadPool* pool_;
+  size_t grain_;
+  Body* body_;
+  Hook* hook_;
+  std::atomic<size_t> remaining_;
+  std::atomic<bool> started_ = false;
+  std::atomic<uint32_t> finished_ = 0;
+};
+
+template <typename Body, typename Hook>
+void RunParallel(Range range, size_t grain, Body* body, const ParallelOptions& options,
+                 Hook* hook) {
+  if (hook != nullptr) hook->Start();
+  if (range.size() == 0) {
+    if (hook != nullptr) {
+      for (int i = 0; i < 3; i++) hook->Split();
+    }
+    return;
+  }
+  auto* pool = options.pool != nullptr ? options.pool : &ThreadPool::Global();
+  ParallelLoop<Body, Hook> loop(pool, std::max<size_t>(grain, 1), range.size(), body,
+                                hook);
+  loop.Run(range, options.affinity);
+}
+
+}  // namespace internal
+
+/**
+ * \brief Call fn(chunk) for chunks of at most grain indices that together cover range,
+ * in parallel, and return when all calls have returned.
+ *
+ * The range is split adaptively, only when idle workers steal work, so the grain can be
+ * small without creating many tasks. fn must not throw.
+ *
+ * \param range The range of indices.
+ * \param grain The maximum number of indices per call of fn.
+ * \param fn A callable that takes a Range.
+ * \param options The pool to run on and the placement of the work.
+ * \param hook If not null, a SplitTimer<3> or a type with the same Start() and Split(),
+ *             which is started on entry and split when the first chunk starts
+ *             (scheduling), when the last chunk is done (compute) and on return (join).
+ */
+template <typename F, typename Hook = SplitTimer<3>>
+void parallel_for(Range range, size_t grain, F&& fn, const ParallelOptions& options = {},
+                  Hook* hook = nullptr) {
+  internal::ForBody<F> body{fn};
+  internal::RunParallel(range, grain, &body, options, hook);
+}
+
+/**
+ * \brief Reduce a range in parallel.
+ *
+ * Every task combines the results of map(chunk) for the chunks it runs, starting from
+ * identity, and then combines its result into the total. Since tasks are created
+ * dynamically, combine must be associative and commutative.
+ *
+ * \param range The range of indices.
+ * \param grain The maximum number of indices per call of map.
+ * \param identity The identity of combine.
+ * \param map A callable that takes a Range and returns a T.
+ * \param combine A callable that takes two T and returns a T.
+ * \param options The pool to run on and the placement of the work.
+ * \param hook As for parallel_for().
+ * \return The combination of identity with the results of map for all chunks.
+ */
+template <typename T, typename Map, typename Combine, typename Hook = SplitTimer<3>>
+auto parallel_reduce(Range range, size_t grain, T identity, Map&& map, Combine&& combine,
+                     const ParallelOptions& options = {}, Hook* hook = nullptr) -> T {
+  internal::ReduceBody<T, Map, Combine> body{identity, map, combine, identity, {}};
+  internal::RunParallel(range, grain, &body, options, hook);
+  return std::move(body.result);
+}
+
+}  // namespace putong
@@ -0,0 +1,84 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The putong C++20 named module.
+//
+// The headers are included in the global module fragment, and the public names are
+// exported from the module purview with using-declarations. Code that uses `import
+// putong;` therefore sees the same entities as code that includes putong/putong.h, so
+// both can be mixed in one program.
+
+module;
+
+#include "putong/putong.h"
+
+export module putong;
+
+export namespace putong {
+
+// Timers.
+using putong::AllocTimer;
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+using putong::CoroutineTimer;
+#endif
+#if defined(__linux__)
+using putong::DualTimer;
+#endif
+using putong::EwmaTimer;
+using putong::Histogram;
+using putong::Meter;
+using putong::Registry;
+using putong::RegistryError;
+using putong::RollingHistogram;
+#if defined(__linux__)
+using putong::SchedStats;
+using putong::SchedTimer;
+#endif
+using putong::SplitTimer;
+using putong::Timer;
+using putong::Zone;
+using putong::ZoneProfiler;
+
+// Memory.
+using putong::AllocStats;
+using putong::Arena;
+using putong::ArenaError;
+using putong::ObjectPool;
+
+// Concurrency.
+using putong::EventCount;
+using putong::MpscQueue;
+using putong::parallel_for;
+using putong::parallel_reduce;
+using putong::ParallelOptions;
+using putong::Range;
+using putong::SpscQueue;
+using putong::ThreadPool;
+using putong::ThreadPoolError;
+
+// Statuses.
+using putong::InternedString;
+using putong::InternPool;
+using putong::Status;
+using putong::status_category;
+using putong::StatusBatch;
+using putong::StatusCategory;
+using putong::StatusType;
+
+// Reporting.
+using putong::operator<<;
+using putong::report;
+using putong::str;
+
+}  // namespace putong
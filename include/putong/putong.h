@@ -14,8 +14,24 @@
 
 #pragma once
 
+#include "putong/alloc.h"
+#include "putong/arena.h"
+#include "putong/coroutine_timer.h"
+#include "putong/dual_timer.h"
+#include "putong/histogram.h"
+#include "putong/meter.h"
+#include "putong/object_pool.h"
+#include "putong/parallel.h"
+#include "putong/queue.h"
+#include "putong/registry.h"
+#include "putong/sched_timer.h"
 #include "putong/status.h"
+#include "putong/status_batch.h"
+#include "putong/status_io.h"
+#include "putong/thread_pool.h"
 #include "putong/timer.h"
+#include "putong/timer_report.h"
+#include "putong/zone.h"
 
 /// @brief A collection of arguably useful templates and functions.
 ///
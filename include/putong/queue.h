@@ -0,0 +1,371 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "putong/sync.h"
+
+namespace putong {
+
+namespace internal {
+
+/// @brief Return the smallest power of two that is at least n, and at least two.
+constexpr auto RoundUpToPowerOfTwo(size_t n) -> size_t {
+  size_t result = 2;
+  while (result < n) result *= 2;
+  return result;
+}
+
+/// @brief Uninitialized storage for an object of type T.
+template <typename T>
+struct Storage {
+  auto get() -> T* { return std::launder(reinterpret_cast<T*>(bytes)); }
+  alignas(T) unsigned char bytes[sizeof(T)];
+};
+
+/// @brief The blocking state of a queue, used when blocking operations are enabled.
+template <bool blocking>
+struct QueueWaiters {
+  void NotifyPushed() { not_empty.NotifyOne(); }
+  void NotifyPopped() { not_full.NotifyAll(); }
+  void NotifyClosed() {
+    closed.store(true, std::memory_order_release);
+    not_empty.NotifyAll();
+    not_full.NotifyAll();
+  }
+
+  EventCount not_empty;
+  EventCount not_full;
+  std::atomic<bool> closed = false;
+};
+
+template <>
+struct QueueWaiters<false> {
+  void NotifyPushed() {}
+  void NotifyPopped() {}
+};
+
+}  // namespace internal
+
+/**
+ * \brief A bounded single-producer single-consumer ring queue.
+ *
+ * The capacity is rounded up to a power of two, so that positions are mapped to slots
+ * with a mask. The producer and consumer each own an index on their own cache line, and
+ * each keeps a cached copy of the index of the other side, which it only refreshes when
+ * the queue appears full or empty. Hence, in the steady state, pushing and popping
+ * touch only one shared cache line: that of the slot.
+ *
+ * \tparam T The type of the elements.
+ * \tparam blocking Enables the blocking Push(), Pop() and Close(), which wait on a futex.
+ *                  This adds a fence to every push and pop, so it is disabled by default.
+ */
+template <typename T, bool blocking = false>
+class SpscQueue {
+ public:
+  explicit SpscQueue(size_t capacity)
+      : mask_(internal::RoundUpToPowerOfTwo(capacity) - 1),
+        slots_(std::make_unique<internal::Storage<T>[]>(mask_ + 1)) {}
+
+  SpscQueue(const SpscQueue&) = delete;
+  auto operator=(const SpscQueue&) -> SpscQueue& = delete;
+
+  ~SpscQueue() {
+    auto tail = tail_.value.load(std::memory_order_acquire);
+    for (auto i = head_.value.load(std::memory_order_relaxed); i != tail; i++) {
+      slots_[i & mask_].get()->~T();
+    }
+  }
+
+  /// @brief Return the capacity of the queue.
+  [[nodiscard]] auto capacity() const -> size_t { return mask_ + 1; }
+
+  /// @brief Push an element. Return false if the queue is full. Producer only.
+  template <typename U>
+  auto TryPush(U&& item) -> bool {
+    auto tail = tail_.value.load(std::memory_order_relaxed);
+    if (tail - head_cache_.value > mask_) {
+      head_cache_.value = head_.value.load(std::memory_order_acquire);
+      if (tail - head_cache_.value > mask_) return false;
+    }
+    new (slots_[tail & mask_].bytes) T(std::forward<U>(item));
+    tail_.value.store(tail + 1, std::memory_order_release);
+    waiters_.NotifyPushed();
+    return true;
+  }
+
+  /// @brief Push up to n elements. Return the number of pushed elements. Producer only.
+  auto TryPushBatch(const T* items, size_t n) -> size_t {
+    auto tail = tail_.value.load(std::memory_order_relaxed);
+    auto free = mask_ + 1 - (tail - head_cache_.value);
+    if (free < n) {
+      head_cache_.value = head_.value.load(std::memory_order_acquire);
+      free = mask_ + 1 - (tail - head_cache_.value);
+    }
+    n = std::min(n, free);
+    if (n == 0) return 0;
+    for (size_t i = 0; i < n; i++) new (slots_[(tail + i) & mask_].bytes) T(items[i]);
+    tail_.value.store(tail + n, std::memory_order_release);
+    waiters_.NotifyPushed();
+    return n;
+  }
+
+  /// @brief Pop an element. Return false if the queue is empty. Consumer only.
+  auto TryPop(T* out) -> bool {
+    auto head = head_.value.load(std::memory_order_relaxed);
+    if (head == tail_cache_.value) {
+      tail_cache_.value = tail_.value.load(std::memory_order_acquire);
+      if (head == tail_cache_.value) return false;
+    }
+    auto* item = slots_[head & mask_].get();
+    *out = std::move(*item);
+    item->~T();
+    head_.value.store(head + 1, std::memory_order_release);
+    waiters_.NotifyPopped();
+    return true;
+  }
+
+  /// @brief Pop up to n elements. Return the number of popped elements. Consumer only.
+  auto TryPopBatch(T* out, size_t n) -> size_t {
+    auto head = head_.value.load(std::memory_order_relaxed);
+    if (tail_cache_.value - head < n) {
+      tail_cache_.value = tail_.value.load(std::memory_order_acquire);
+    }
+    n = std::min(n, tail_cache_.value - head);
+    if (n == 0) return 0;
+    for (size_t i = 0; i < n; i++) {
+      auto* item = slots_[(head + i) & mask_].get();
+      out[i] = std::move(*item);
+      item->~T();
+    }
+    head_.value.store(head + n, std::memory_order_release);
+    waiters_.NotifyPopped();
+    return n;
+  }
+
+  /// @brief Push an element, waiting while the queue is full. Return false if closed.
+  template <typename U>
+  auto Push(U&& item) -> bool {
+    static_assert(blocking, "blocking operations are disabled");
+    bool pushed = false;
+    waiters_.not_full.Await([&] {
+      if (waiters_.closed.load(std::memory_order_acquire)) return true;
+      pushed = TryPush(std::forward<U>(item));
+      return pushed;
+    });
+    return pushed;
+  }
+
+  /// @brief Pop an element, waiting while the queue is empty. Return false if the queue
+  /// is closed and empty.
+  auto Pop(T* out) -> bool {
+    static_assert(blocking, "blocking operations are disabled");
+    bool popped = false;
+    waiters_.not_empty.Await([&] {
+      // Check for closing first, so that elements pushed before closing are popped.
+      bool closed = waiters_.closed.load(std::memory_order_acquire);
+      popped = TryPop(out);
+      return popped || closed;
+    });
+    return popped;
+  }
+
+  /// @brief Close the queue, waking up all blocked producers and consumers.
+  void Close() {
+    static_assert(blocking, "blocking operations are disabled");
+    waiters_.NotifyClosed();
+  }
+
+ private:
+  const size_t mask_;
+  std::unique_ptr<internal::Storage<T>[]> slots_;
+  // Written by the consumer.
+  Padded<std::atomic<size_t>> head_;
+  Padded<size_t> tail_cache_;
+  // Written by the producer.
+  Padded<std::atomic<size_t>> tail_;
+  Padded<size_t> head_cache_;
+  internal::QueueWaiters<blocking> waiters_;
+};
+
+/**
+ * \brief A bounded multi-producer single-consumer ring queue.
+ *
+ * This is Dmitry Vyukov's bounded queue, restricted to a single consumer. Every slot
+ * holds a sequence number that tells producers and the consumer whether the slot is
+ * free or full in the current round, so producers only contend on the tail index, and
+ * the consumer does not need to read it at all.
+ *
+ * \tparam T The type of the elements.
+ * \tparam blocking Enables the blocking Push(), Pop() and Close(), which wait on a futex.
+ */
+template <typename T, bool blocking = false>
+class MpscQueue {
+ public:
+  explicit MpscQueue(size_t capacity)
+      : mask_(internal::RoundUpToPowerOfTwo(capacity) - 1),
+        slots_(std::make_unique<Slot[]>(mask_ + 1)) {
+    for (size_t i = 0; i <= mask_; i++) slots_[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  MpscQueue(const MpscQueue&) = delete;
+  auto operator=(const MpscQueue&) -> MpscQueue& = delete;
+
+  ~MpscQueue() {
+    for (auto i = head_.value;; i++) {
+      auto& slot = slots_[i & mask_];
+      if (slot.seq.load(std::memory_order_acquire) != i + 1) break;
+      slot.storage.get()->~T();
+    }
+  }
+
+  /// @brief Return the capacity of the queue.
+  [[nodiscard]] auto capacity() const -> size_t { return mask_ + 1; }
+
+  /// @brief Push an element. Return false if the queue is full.
+  template <typename U>
+  auto TryPush(U&& item) -> bool {
+    size_t pos = 0;
+    if (!Claim(1, &pos)) return false;
+    Publish(pos, std::forward<U>(item));
+    waiters_.NotifyPushed();
+    return true;
+  }
+
+  /// @brief Push n elements to consecutive positions. Return false, without pushing any,
+  /// if the queue does not have room for all of them.
+  auto TryPushBatch(const T* items, size_t n) -> bool {
+    if (n == 0) return true;
+    size_t pos = 0;
+    if (n > mask_ + 1 || !Claim(n, &pos)) return false;
+    for (size_t i = 0; i < n; i++) Publish(pos + i, items[i]);
+    waiters_.NotifyPushed();
+    return true;
+  }
+
+  /// @brief Pop an element. Return false if the queue is empty. Consumer only.
+  auto TryPop(T* out) -> bool {
+    auto& slot = slots_[head_.value & mask_];
+    if (slot.seq.load(std::memory_order_acquire) != head_.value + 1) return false;
+    auto* item = slot.storage.get();
+    *out = std::move(*item);
+    item->~T();
+    slot.seq.store(head_.value + mask_ + 1, std::memory_order_release);
+    head_.value++;
+    waiters_.NotifyPopped();
+    return true;
+  }
+
+  /// @brief Pop up to n elements. Return the number of popped elements. Consumer only.
+  auto TryPopBatch(T* out, size_t n) -> size_t {
+    size_t popped = 0;
+    for (; popped < n; popped++) {
+      auto& slot = slots_[head_.value & mask_];
+      if (slot.seq.load(std::memory_order_acquire) != head_.value + 1) break;
+      auto* item = slot.storage.get();
+      out[popped] = std::move(*item);
+      item->~T();
+      slot.seq.store(head_.value + mask_ + 1, std::memory_order_release);
+      head_.value++;
+    }
+    if (popped > 0) waiters_.NotifyPopped();
+    return popped;
+  }
+
+  /// @brief Push an element, waiting while the queue is full. Return false if closed.
+  template <typename U>
+  auto Push(U&& item) -> bool {
+    static_assert(blocking, "blocking operations are disabled");
+    bool pushed = false;
+    waiters_.not_full.Await([&] {
+      if (waiters_.closed.load(std::memory_order_acquire)) return true;
+      pushed = TryPush(std::forward<U>(item));
+      return pushed;
+    });
+    return pushed;
+  }
+
+  /// @brief Pop an element, waiting while the queue is empty. Return false if the queue
+  /// is closed and empty.
+  auto Pop(T* out) -> bool {
+    static_assert(blocking, "blocking operations are disabled");
+    bool popped = false;
+    waiters_.not_empty.Await([&] {
+      // Check for closing first, so that elements pushed before closing are popped.
+      bool closed = waiters_.closed.load(std::memory_order_acquire);
+      popped = TryPop(out);
+      return popped || closed;
+    });
+    return popped;
+  }
+
+  /// @brief Close the queue, waking up all blocked producers and the consumer.
+  void Close() {
+    static_assert(blocking, "blocking operations are disabled");
+    waiters_.NotifyClosed();
+  }
+
+ private:
+  struct Slot {
+    std::atomic<size_t> seq;
+    internal::Storage<T> storage;
+  };
+
+  /// Claim n consecutive positions. Since the consumer frees slots in order, they are all
+  /// free if the last one is.
+  auto Claim(size_t n, size_t* pos) -> bool {
+    auto tail = tail_.value.load(std::memory_order_relaxed);
+    while (true) {
+      auto last = tail + n - 1;
+      auto seq = slots_[last & mask_].seq.load(std::memory_order_acquire);
+      auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(last);
+      if (diff == 0) {
+        if (tail_.value.compare_exchange_weak(tail, tail + n,
+                                              std::memory_order_relaxed)) {
+          *pos = tail;
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        tail = tail_.value.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  template <typename U>
+  void Publish(size_t pos, U&& item) {
+    auto& slot = slots_[pos & mask_];
+    new (slot.storage.bytes) T(std::forward<U>(item));
+    slot.seq.store(pos + 1, std::memory_order_release);
+  }
+
+  const size_t mask_;
+  std::unique_ptr<Slot[]> slots_;
+  Padded<std::atomic<size_t>> tail_;
+  // Only accessed by the consumer.
+  Padded<size_t> head_;
+  internal::QueueWaiters<blocking> waiters_;
+};
+
+}  // namespace putong
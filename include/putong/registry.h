@@ -0,0 +1,239 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "putong/histogram.h"
+#include "putong/meter.h"
+#include "putong/status.h"
+
+namespace putong {
+
+enum class RegistryError { File };
+
+/**
+ * \brief A set of named metrics that can be rendered in the OpenMetrics text format.
+ *
+ * Metrics are created on first lookup and are never destroyed or moved, so a pointer
+ * obtained once can be cached and used on the hot path without further lookups.
+ * Recording into a metric does not involve the registry, so rendering, which only
+ * takes the lock of the registry, never blocks recorders.
+ *
+ * Histograms, rolling histograms and EWMA timers are assumed to record nanoseconds and
+ * are rendered as summaries in seconds, the base unit of OpenMetrics. The quantiles of
+ * an empty histogram are rendered as NaN, so they do not read as observations of zero.
+ * Meters are rendered as counters, with their moving averages as a gauge.
+ */
+class Registry {
+ public:
+  /// @brief The quantiles that summaries are rendered with.
+  static constexpr double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+  Registry() = default;
+  Registry(const Registry&) = delete;
+  auto operator=(const Registry&) -> Registry& = delete;
+
+  /// @brief Return the process-wide registry, which is never destroyed.
+  static auto Global() -> Registry& {
+    static auto* registry = new Registry();
+    return *registry;
+  }
+
+  /**
+   * \brief Return the metric of type T with the given name, creating it if required.
+   *
+   * \tparam T One of Histogram, RollingHistogram<>, Meter<> or EwmaTimer<>.
+   * \param name The name, which must match [a-zA-Z_:][a-zA-Z0-9_:]*.
+   * \param help The help text, only used when the metric is created.
+   * \param args The constructor arguments, only used when the metric is created.
+   * \return The metric, or nullptr if the name is invalid or used by another type.
+   */
+  template <typename T, typename... Args>
+  auto Get(std::string_view name, std::string_view help = {}, Args&&... args) -> T* {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(name);
+    if (it != index_.end()) {
+      auto* metric = std::get_if<std::unique_ptr<T>>(&entries_[it->second].metric);
+      return metric == nullptr ? nullptr : metric->get();
+    }
+    if (!ValidName(name)) return nullptr;
+    auto metric = std::make_unique<T>(std::forward<Args>(args)...);
+    auto* result = metric.get();
+    index_.emplace(std::string(name), entries_.size());
+    entries_.push_back({std::string(name), std::string(help), std::move(metric)});
+    return result;
+  }
+
+  /// @brief Return the number of metrics.
+  [[nodiscard]] auto size() const -> size_t {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+  }
+
+  /**
+   * \brief Render all metrics in the OpenMetrics text format.
+   *
+   * \param out The buffer to render into. It is cleared first, so that a buffer that is
+   *            reused for every scrape keeps its capacity and does not allocate.
+   */
+  void Render(std::string* out) {
+    out->clear();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& e : entries_) {
+      if (auto* h = std::get_if<std::unique_ptr<Histogram>>(&e.metric)) {
+        RenderSummary(out, e, **h);
+      } else if (auto* r = std::get_if<std::unique_ptr<RollingHistogram<>>>(&e.metric)) {
+        RenderSummary(out, e, (*r)->Snapshot());
+      } else if (auto* m = std::get_if<std::unique_ptr<Meter<>>>(&e.metric)) {
+        RenderMeter(out, e, m->get());
+      } else if (auto* t = std::get_if<std::unique_ptr<EwmaTimer<>>>(&e.metric)) {
+        RenderEwmaTimer(out, e, t->get());
+      }
+    }
+    out->append("# EOF\n");
+  }
+
+  /**
+   * \brief Render all metrics into a file.
+   *
+   * The metrics are written to a temporary file next to path, which then replaces path,
+   * so that a concurrent reader of path never sees a partial exposition.
+   */
+  auto WriteFile(const std::string& path) -> Status<RegistryError> {
+    std::lock_guard<std::mutex> lock(file_mutex_);
+    Render(&file_buffer_);
+    auto tmp = path + ".tmp";
+    FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (f == nullptr) {
+      return Status<RegistryError>::FromErrno(RegistryError::File, errno, tmp);
+    }
+    bool ok = std::fwrite(file_buffer_.data(), 1, file_buffer_.size(), f) ==
+              file_buffer_.size();
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok) return Status<RegistryError>::FromErrno(RegistryError::File, errno, tmp);
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+      return Status<RegistryError>::FromErrno(RegistryError::File, errno, path);
+    }
+    return Status<RegistryError>::OK();
+  }
+
+ private:
+  using Metric =
+      std::variant<std::unique_ptr<Histogram>, std::unique_ptr<RollingHistogram<>>,
+                   std::unique_ptr<Meter<>>, std::unique_ptr<EwmaTimer<>>>;
+
+  struct Entry {
+    std::string name;
+    std::string help;
+    Metric metric;
+  };
+
+  static auto ValidName(std::string_view name) -> bool {
+    if (name.empty()) return false;
+    for (size_t i = 0; i < name.size(); i++) {
+      char c = name[i];
+      bool alpha =
+          (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == ':';
+      if (!alpha && !(i > 0 && c >= '0' && c <= '9')) return false;
+    }
+    return true;
+  }
+
+  static void Header(std::string* out, std::string_view name, const char* suffix,
+                     const char* type, std::string_view help) {
+    out->append("# TYPE ").append(name).append(suffix);
+    out->append(" ").append(type).append("\n");
+    if (help.empty()) return;
+    out->append("# HELP ").append(name).append(suffix).append(" ");
+    for (char c : help) {
+      if (c == '\\') {
+        out->append("\\\\");
+      } else if (c == '\n') {
+        out->append("\\n");
+      } else if (c == '"') {
+        out->append("\\\"");
+      } else {
+        out->push_back(c);
+      }
+    }
+    out->push_back('\n');
+  }
+
+  static void Sample(std::string* out, std::string_view name, const char* suffix,
+                     const char* label, double value) {
+    char buf[64];
+    if (std::isnan(value)) {
+      std::snprintf(buf, sizeof(buf), " NaN\n");
+    } else {
+      std::snprintf(buf, sizeof(buf), " %.9g\n", value);
+    }
+    out->append(name).append(suffix);
+    if (label != nullptr) out->append(label);
+    out->append(buf);
+  }
+
+  static void RenderSummary(std::string* out, const Entry& e, const Histogram& h) {
+    Header(out, e.name, "", "summary", e.help);
+    char label[32];
+    for (auto q : kQuantiles) {
+      std::snprintf(label, sizeof(label), "{quantile=\"%g\"}", q);
+      auto value = h.count() == 0 ? std::numeric_limits<double>::quiet_NaN()
+                                  : h.Percentile(q * 100) * 1e-9;
+      Sample(out, e.name, "", label, value);
+    }
+    Sample(out, e.name, "_sum", nullptr, h.sum() * 1e-9);
+    Sample(out, e.name, "_count", nullptr, static_cast<double>(h.count()));
+  }
+
+  static void RenderMeter(std::string* out, const Entry& e, Meter<>* m) {
+    Header(out, e.name, "", "counter", e.help);
+    Sample(out, e.name, "_total", nullptr, static_cast<double>(m->count()));
+    Header(out, e.name, "_rate", "gauge", {});
+    Sample(out, e.name, "_rate", "{window=\"1m\"}", m->rate1());
+    Sample(out, e.name, "_rate", "{window=\"5m\"}", m->rate5());
+    Sample(out, e.name, "_rate", "{window=\"15m\"}", m->rate15());
+  }
+
+  static void RenderEwmaTimer(std::string* out, const Entry& e, EwmaTimer<>* t) {
+    Header(out, e.name, "", "summary", e.help);
+    Sample(out, e.name, "_sum", nullptr, t->sum() * 1e-9);
+    Sample(out, e.name, "_count", nullptr, static_cast<double>(t->count()));
+    Header(out, e.name, "_mean", "gauge", {});
+    Sample(out, e.name, "_mean", "{window=\"1m\"}", t->mean1() * 1e-9);
+    Sample(out, e.name, "_mean", "{window=\"5m\"}", t->mean5() * 1e-9);
+    Sample(out, e.name, "_mean", "{window=\"15m\"}", t->mean15() * 1e-9);
+  }
+
+  mutable std::mutex mutex_;
+  std::vector<Entry> entries_;
+  std::map<std::string, size_t, std::less<>> index_;
+  std::mutex file_mutex_;
+  std::string file_buffer_;
+};
+
+}  // namespace putong
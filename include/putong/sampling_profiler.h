@@ -0,0 +1,377 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+#endif
+
+#include "putong/backtrace.h"
+#include "putong/status.h"
+#include "putong/timer.h"
+
+namespace putong {
+
+enum class SamplingError { Unsupported, AlreadyRunning, Signal, Timer, File };
+
+/**
+ * \brief A sampling profiler driven by per-thread CPU-time timers and SIGPROF.
+ *
+ * Threads opt in with RegisterThread(), which preallocates a sample buffer and creates a
+ * POSIX timer on the CPU-time clock of the thread that delivers SIGPROF to that thread
+ * only. The signal handler records the interrupted program counter and, if the thread
+ * tracks a SplitTimer, the index of its current split. It is async-signal-safe: it only
+ * touches the preallocated buffer and lock-free atomics, and never allocates.
+ *
+ * Samples are aggregated offline, after Stop(), as folded stacks or as a pprof profile.
+ * This is only supported on Linux. Programs may need to link librt for timer_create.
+ */
+class SamplingProfiler {
+ public:
+  /// @brief A single sample.
+  struct Sample {
+    uintptr_t pc;
+    /// @brief One plus the index of the current interval of the tracked SplitTimer, or
+    /// zero if the thread tracks no started SplitTimer.
+    uint32_t stage;
+  };
+
+  /// @brief Return the process-wide profiler, which is never destroyed.
+  static auto Global() -> SamplingProfiler& {
+    static auto* profiler = new SamplingProfiler();
+    return *profiler;
+  }
+
+  /**
+   * \brief Install the SIGPROF handler and arm the timers of all registered threads.
+   *
+   * \param frequency_hz The number of samples per second of CPU time of each thread.
+   */
+  auto Start(int frequency_hz = 99) -> Status<SamplingError> {
+#if defined(__linux__)
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) return Status<SamplingError>(SamplingError::AlreadyRunning, "running");
+    if (frequency_hz <= 0 || frequency_hz > 1000000) {
+      return Status<SamplingError>(SamplingError::Timer, "invalid sampling frequency");
+    }
+    struct sigaction action {};
+    action.sa_sigaction = &SamplingProfiler::Handler;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &previous_) != 0) {
+      return Status<SamplingError>::FromErrno(SamplingError::Signal, errno, "sigaction");
+    }
+    period_ns_ = 1000000000 / frequency_hz;
+    running_ = true;
+    for (auto& buffer : buffers_) {
+      if (buffer->armed) {
+        auto status = Arm(buffer.get(), period_ns_);
+        if (!status.ok()) {
+          // Undo everything, so that Start() can be called again.
+          DisarmAll();
+          return status;
+        }
+      }
+    }
+    return Status<SamplingError>::OK();
+#else
+    (void)frequency_hz;
+    return Status<SamplingError>(SamplingError::Unsupported, "requires Linux");
+#endif
+  }
+
+  /// @brief Disarm all timers and restore the previous SIGPROF handler.
+  void Stop() {
+#if defined(__linux__)
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) DisarmAll();
+#endif
+  }
+
+  /**
+   * \brief Start sampling the calling thread.
+   *
+   * \param capacity The maximum number of samples recorded for this thread. Samples
+   *                 beyond this are counted as dropped.
+   */
+  auto RegisterThread(size_t capacity = 1 << 16) -> Status<SamplingError> {
+#if defined(__linux__)
+    if (buffer_ != nullptr) return Status<SamplingError>::OK();
+    auto buffer = std::make_unique<ThreadBuffer>(capacity);
+    buffer->tid = static_cast<pid_t>(syscall(SYS_gettid));
+    sigevent event{};
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event._sigev_un._tid = buffer->tid;
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &buffer->timer) != 0) {
+      return Status<SamplingError>::FromErrno(SamplingError::Timer, errno,
+                                              "timer_create");
+    }
+    buffer->armed = true;
+    // Delete the timer if the thread exits without calling UnregisterThread().
+    thread_local ThreadExit exit{this};
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Publish the buffer to the handler before the timer can fire.
+    buffer_ = buffers_.emplace_back(std::move(buffer)).get();
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    if (running_) return Arm(buffer_, period_ns_);
+    return Status<SamplingError>::OK();
+#else
+    (void)capacity;
+    return Status<SamplingError>(SamplingError::Unsupported, "requires Linux");
+#endif
+  }
+
+  /// @brief Stop sampling the calling thread. Its samples are kept. This is also done
+  /// when a registered thread exits.
+  void UnregisterThread() {
+#if defined(__linux__)
+    if (buffer_ == nullptr) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    timer_delete(buffer_->timer);
+    buffer_->armed = false;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    buffer_ = nullptr;
+#endif
+  }
+
+  /**
+   * \brief Attributes samples of the calling thread to the current split of a SplitTimer
+   * while it lives. The thread then tracks the timer it tracked before.
+   */
+  class Tracking {
+   public:
+    Tracking(const Tracking&) = delete;
+    auto operator=(const Tracking&) -> Tracking& = delete;
+    ~Tracking() { stage_ = previous_; }
+
+   private:
+    friend class SamplingProfiler;
+    explicit Tracking(const std::atomic<size_t>* stage) : previous_(stage_) {
+      stage_ = stage;
+    }
+
+    const std::atomic<size_t>* previous_;
+  };
+
+  /**
+   * \brief Attribute samples of the calling thread to the current split of a timer, until
+   * the returned guard is destroyed.
+   *
+   * The signal handler reads the timer, so it must outlive the guard.
+   */
+  template <unsigned int num_splits, typename clock>
+  [[nodiscard]] static auto Track(const SplitTimer<num_splits, clock>& timer)
+      -> Tracking {
+    return Tracking(&timer.split_idx);
+  }
+
+  /// @brief Return all samples of all threads. Only call this while stopped.
+  auto Samples() -> std::vector<Sample> {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Sample> result;
+    for (auto& buffer : buffers_) {
+      auto n = buffer->size.load(std::memory_order_acquire);
+      result.insert(result.end(), buffer->samples.get(), buffer->samples.get() + n);
+    }
+    return result;
+  }
+
+  /// @brief Return the number of samples that did not fit in their thread's buffer.
+  auto dropped() -> uint64_t {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t result = 0;
+    for (auto& buffer : buffers_) {
+      result += buffer->dropped.load(std::memory_order_relaxed);
+    }
+    return result;
+  }
+
+  /// @brief Discard all samples.
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& buffer : buffers_) {
+      buffer->size.store(0, std::memory_order_release);
+      buffer->dropped.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * \brief Render the samples as folded stacks, one line per stage and function.
+   *
+   * Lines have the form "stage 2;function <samples>". The stage frame is omitted for
+   * samples without a tracked SplitTimer. Functions that cannot be symbolized are
+   * rendered as their address.
+   */
+  auto FoldedStacks() -> std::string {
+    std::map<std::pair<uint32_t, uintptr_t>, uint64_t> counts;
+    for (const auto& s : Samples()) counts[{s.stage, s.pc}]++;
+    std::map<std::string, uint64_t> folded;
+    for (const auto& [key, count] : counts) {
+      auto name = SymbolName(reinterpret_cast<const void*>(key.second));
+      if (name.empty()) {
+        char addr[32];
+        std::snprintf(addr, sizeof(addr), "0x%zx", static_cast<size_t>(key.second));
+        name = addr;
+      }
+      if (key.first != 0) name = "stage " + std::to_string(key.first - 1) + ";" + name;
+      folded[name] += count;
+    }
+    std::string result;
+    for (const auto& [stack, count] : folded) {
+      result += stack + " " + std::to_string(count) + "\n";
+    }
+    return result;
+  }
+
+  /**
+   * \brief Write the samples as a legacy pprof CPU profile.
+   *
+   * The legacy format has no notion of stages, so these are not included.
+   */
+  auto WritePprof(const std::string& path) -> Status<SamplingError> {
+    std::map<uintptr_t, uintptr_t> counts;
+    for (const auto& s : Samples()) counts[s.pc]++;
+
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if (f == nullptr) {
+      return Status<SamplingError>::FromErrno(SamplingError::File, errno, path);
+    }
+    auto period_us = static_cast<uintptr_t>(period_ns_ / 1000);
+    std::vector<uintptr_t> words = {0, 3, 0, period_us, 0};
+    for (const auto& [pc, count] : counts) {
+      words.insert(words.end(), {count, 1, pc});
+    }
+    words.insert(words.end(), {0, 1, 0});
+    bool ok =
+        std::fwrite(words.data(), sizeof(uintptr_t), words.size(), f) == words.size();
+    // pprof resolves addresses using the memory map of the process.
+    if (FILE* maps = std::fopen("/proc/self/maps", "rb")) {
+      char chunk[4096];
+      for (size_t n; (n = std::fread(chunk, 1, sizeof(chunk), maps)) > 0;) {
+        ok = ok && std::fwrite(chunk, 1, n, f) == n;
+      }
+      std::fclose(maps);
+    }
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok) return Status<SamplingError>::FromErrno(SamplingError::File, errno, path);
+    return Status<SamplingError>::OK();
+  }
+
+ private:
+  struct ThreadBuffer {
+    explicit ThreadBuffer(size_t capacity)
+        : capacity(capacity), samples(std::make_unique<Sample[]>(capacity)) {}
+
+    size_t capacity;
+    std::unique_ptr<Sample[]> samples;
+    std::atomic<size_t> size = 0;
+    std::atomic<uint64_t> dropped = 0;
+#if defined(__linux__)
+    pid_t tid = 0;
+    timer_t timer{};
+#endif
+    bool armed = false;
+  };
+
+  struct ThreadExit {
+    ~ThreadExit() { profiler->UnregisterThread(); }
+    SamplingProfiler* profiler;
+  };
+
+  SamplingProfiler() = default;
+
+#if defined(__linux__)
+  /// Disarm the timers of all registered threads and restore the previous handler.
+  /// The mutex must be held.
+  void DisarmAll() {
+    for (auto& buffer : buffers_) {
+      if (buffer->armed) Arm(buffer.get(), 0);
+    }
+    sigaction(SIGPROF, &previous_, nullptr);
+    running_ = false;
+  }
+
+  static auto Arm(ThreadBuffer* buffer, int64_t period_ns) -> Status<SamplingError> {
+    itimerspec spec{};
+    spec.it_interval.tv_sec = period_ns / 1000000000;
+    spec.it_interval.tv_nsec = period_ns % 1000000000;
+    spec.it_value = spec.it_interval;
+    if (timer_settime(buffer->timer, 0, &spec, nullptr) != 0) {
+      return Status<SamplingError>::FromErrno(SamplingError::Timer, errno,
+                                              "timer_settime");
+    }
+    return Status<SamplingError>::OK();
+  }
+
+  static auto ProgramCounter(void* context) -> uintptr_t {
+    auto* uc = static_cast<ucontext_t*>(context);
+#if defined(__x86_64__)
+    return static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_RIP]);
+#elif defined(__i386__)
+    return static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_EIP]);
+#elif defined(__aarch64__)
+    return static_cast<uintptr_t>(uc->uc_mcontext.pc);
+#else
+    (void)uc;
+    return 0;
+#endif
+  }
+
+  static void Handler(int, siginfo_t*, void* context) {
+    auto* buffer = buffer_;
+    if (buffer == nullptr) return;
+    auto* stage = stage_;
+    auto idx = buffer->size.load(std::memory_order_relaxed);
+    if (idx >= buffer->capacity) {
+      buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    uint32_t split = 0;
+    if (stage != nullptr) {
+      split = static_cast<uint32_t>(stage->load(std::memory_order_relaxed));
+    }
+    buffer->samples[idx] = {ProgramCounter(context), split};
+    buffer->size.store(idx + 1, std::memory_order_release);
+  }
+
+  struct sigaction previous_ {};
+#endif
+
+  std::mutex mutex_;
+  bool running_ = false;
+  int64_t period_ns_ = 0;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+  // These are constant-initialized, so they are safe to access from the signal handler.
+  static inline thread_local ThreadBuffer* buffer_ = nullptr;
+  static inline thread_local const std::atomic<size_t>* stage_ = nullptr;
+};
+
+}  // namespace putong
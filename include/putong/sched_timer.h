@@ -0,0 +1,177 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// This header is empty unless the scheduler statistics of Linux are available.
+#if defined(__linux__)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "putong/timer.h"
+
+namespace putong {
+
+/// @brief Scheduler statistics of a thread at one point in time.
+struct SchedStats {
+  /// Whether the run and runqueue times could be read.
+  bool valid = false;
+  /// The time the thread ran on a CPU, in nanoseconds.
+  int64_t run_ns = 0;
+  /// The time the thread was runnable but waited on a runqueue, in nanoseconds.
+  int64_t runqueue_ns = 0;
+  /// The number of times the thread gave up the CPU because it blocked.
+  int64_t voluntary_switches = 0;
+  /// The number of times the thread was preempted.
+  int64_t involuntary_switches = 0;
+
+  /**
+   * \brief Sample the statistics of the calling thread.
+   *
+   * The times are read from /proc/self/task/<tid>/schedstat, which every thread opens
+   * once and then re-reads with a single pread(). The context switches are read with
+   * getrusage(RUSAGE_THREAD).
+   */
+  static auto ForThisThread() -> SchedStats {
+    SchedStats result;
+    thread_local File file;
+    char buf[96];
+    auto n = file.fd < 0 ? -1 : pread(file.fd, buf, sizeof(buf) - 1, 0);
+    if (n > 0) {
+      buf[n] = '\0';
+      long long run = 0;
+      long long runqueue = 0;
+      if (std::sscanf(buf, "%lld %lld", &run, &runqueue) == 2) {
+        result.valid = true;
+        result.run_ns = run;
+        result.runqueue_ns = runqueue;
+      }
+    }
+    rusage usage{};
+    if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+      result.voluntary_switches = usage.ru_nvcsw;
+      result.involuntary_switches = usage.ru_nivcsw;
+    }
+    return result;
+  }
+
+ private:
+  struct File {
+    File() {
+      char path[64];
+      std::snprintf(path, sizeof(path), "/proc/self/task/%ld/schedstat",
+                    static_cast<long>(syscall(SYS_gettid)));
+      fd = open(path, O_RDONLY | O_CLOEXEC);
+    }
+    ~File() {
+      if (fd >= 0) close(fd);
+    }
+    int fd;
+  };
+};
+
+/**
+ * \brief A timer that attributes its interval to running, waiting for a CPU and being
+ * blocked.
+ *
+ * The scheduler statistics of the calling thread are sampled when the timer is started
+ * and stopped. The interval then breaks down into:
+ *  - run time: the thread was on a CPU.
+ *  - runqueue time: the thread was runnable, but waited for a CPU.
+ *  - blocked time: the remainder, in which the thread waited for a lock, for I/O or in
+ *    a sleep. The number of voluntary context switches tells how often it blocked.
+ *
+ * Sampling costs a few system calls, and the kernel only updates the run time of a
+ * running thread at scheduler ticks, so this timer is meant for coarse regions. It must
+ * be started and stopped on the same thread.
+ *
+ * \tparam clock The clock of the interval.
+ */
+template <typename clock = std::chrono::steady_clock>
+class SchedTimer {
+ public:
+  /// @brief Construct a new timer. This also starts the timer if start=true.
+  explicit SchedTimer(bool start = false) {
+    if (start) Start();
+  }
+
+  /// @brief Start the timer.
+  void Start() {
+    start_ = SchedStats::ForThisThread();
+    timer_.Start();
+  }
+
+  /// @brief Stop the timer.
+  void Stop() {
+    timer_.Stop();
+    stop_ = SchedStats::ForThisThread();
+  }
+
+  /// @brief Return whether the run and runqueue times are available.
+  [[nodiscard]] auto valid() const -> bool { return start_.valid && stop_.valid; }
+
+  /// @brief Return the interval in nanoseconds.
+  [[nodiscard]] auto nanoseconds() const -> int64_t { return timer_.nanoseconds(); }
+
+  /// @brief Return the interval in seconds.
+  [[nodiscard]] auto seconds() const -> double { return timer_.seconds(); }
+
+  /// @brief Return the time spent on a CPU in nanoseconds.
+  [[nodiscard]] auto run_nanoseconds() const -> int64_t {
+    return stop_.run_ns - start_.run_ns;
+  }
+
+  /// @brief Return the time spent waiting for a CPU in nanoseconds.
+  [[nodiscard]] auto runqueue_nanoseconds() const -> int64_t {
+    return stop_.runqueue_ns - start_.runqueue_ns;
+  }
+
+  /// @brief Return the time spent blocked in nanoseconds, the interval minus the run and
+  /// runqueue times.
+  [[nodiscard]] auto blocked_nanoseconds() const -> int64_t {
+    auto blocked = nanoseconds() - run_nanoseconds() - runqueue_nanoseconds();
+    return std::max<int64_t>(0, blocked);
+  }
+
+  /// @brief Return the number of voluntary context switches, i.e. times the thread
+  /// blocked.
+  [[nodiscard]] auto voluntary_switches() const -> int64_t {
+    return stop_.voluntary_switches - start_.voluntary_switches;
+  }
+
+  /// @brief Return the number of involuntary context switches, i.e. preemptions.
+  [[nodiscard]] auto involuntary_switches() const -> int64_t {
+    return stop_.involuntary_switches - start_.involuntary_switches;
+  }
+
+  /// @brief Return the underlying timer of the interval.
+  [[nodiscard]] auto timer() const -> const Timer<clock>& { return timer_; }
+
+ private:
+  Timer<clock> timer_;
+  SchedStats start_;
+  SchedStats stop_;
+};
+
+}  // namespace putong
+
+#endif
@@ -14,35 +14,383 @@
 
 #pragma once
 
-#include <chrono>
-#include <iomanip>
-#include <iostream>
-#include <sstream>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
 #include <utility>
 
+#include "putong/intern.h"
+#include "putong/object_pool.h"
+
+/**
+ * \brief The number of return addresses recorded when an error Status is created.
+ *
+ * Zero disables origin tracking. This must have the same value in all translation units
+ * of a program.
+ */
+#ifndef PUTONG_STATUS_TRACE_DEPTH
+#define PUTONG_STATUS_TRACE_DEPTH 0
+#endif
+
+#if PUTONG_STATUS_TRACE_DEPTH > 0
+#include "putong/backtrace.h"
+#endif
+
+// Error constructors are forced inline when origins are tracked, so that the first
+// recorded frame is the function that creates the error rather than putong itself.
+#if PUTONG_STATUS_TRACE_DEPTH > 0 && (defined(__GNUC__) || defined(__clang__))
+#define PUTONG_STATUS_ORIGIN __attribute__((always_inline))
+#else
+#define PUTONG_STATUS_ORIGIN
+#endif
+
 namespace putong {
 
 enum class StatusType : char { OK, Error };
 
+namespace internal {
+
+/**
+ * \brief The context frames of an error status.
+ *
+ * Frames are stored back to back in a single byte arena, each preceded by a header that
+ * links to the previous frame. The arena starts inline and grows geometrically, so
+ * pushing a frame is amortized O(1). Contexts are taken from an ObjectPool, so most
+ * errors do not allocate at all after warm-up.
+ */
+class StatusContext {
+ public:
+  static constexpr size_t kInlineBytes = 232;
+
+  StatusContext() = default;
+  StatusContext(const StatusContext& other) { *this = other; }
+  auto operator=(const StatusContext& other) -> StatusContext& {
+    if (this == &other) return *this;
+    Reserve(other.used_);
+    std::memcpy(data(), other.data(), other.used_);
+    used_ = other.used_;
+    head_ = other.head_;
+    frames_ = other.frames_;
+    chars_ = other.chars_;
+    return *this;
+  }
+
+  /// @brief Push a frame. Frames pushed later are rendered first.
+  void Push(std::string_view frame) {
+    auto bytes = static_cast<uint32_t>(Align(sizeof(Header) + frame.size()));
+    Reserve(used_ + bytes);
+    auto* header = reinterpret_cast<Header*>(data() + used_);
+    header->prev = head_;
+    header->size = static_cast<uint32_t>(frame.size());
+    std::memcpy(data() + used_ + sizeof(Header), frame.data(), frame.size());
+    head_ = used_ + 1;
+    used_ += bytes;
+    frames_++;
+    chars_ += frame.size();
+  }
+
+  /// @brief Apply fn to all frames, from the last pushed to the first pushed.
+  template <typename F>
+  void ForEach(F&& fn) const {
+    for (uint32_t f = head_; f != 0;) {
+      auto* header = reinterpret_cast<const Header*>(data() + f - 1);
+      fn(std::string_view(data() + f - 1 + sizeof(Header), header->size));
+      f = header->prev;
+    }
+  }
+
+  /// @brief Return the number of frames.
+  [[nodiscard]] auto frames() const -> size_t { return frames_; }
+
+  /// @brief Return the total number of characters in all frames.
+  [[nodiscard]] auto chars() const -> size_t { return chars_; }
+
+ private:
+  struct Header {
+    uint32_t prev;  // One plus the offset of the previous frame, or zero.
+    uint32_t size;
+  };
+
+  static constexpr auto Align(size_t n) -> size_t {
+    return (n + alignof(Header) - 1) & ~(alignof(Header) - 1);
+  }
+
+  auto data() -> char* { return overflow_ ? overflow_.get() : inline_; }
+  [[nodiscard]] auto data() const -> const char* {
+    return overflow_ ? overflow_.get() : inline_;
+  }
+
+  void Reserve(size_t bytes) {
+    if (bytes <= capacity_) return;
+    size_t capacity = capacity_;
+    while (capacity < bytes) capacity *= 2;
+    auto grown = std::make_unique<char[]>(capacity);
+    std::memcpy(grown.get(), data(), used_);
+    overflow_ = std::move(grown);
+    capacity_ = static_cast<uint32_t>(capacity);
+  }
+
+  uint32_t head_ = 0;
+  uint32_t used_ = 0;
+  uint32_t capacity_ = kInlineBytes;
+  uint32_t frames_ = 0;
+  size_t chars_ = 0;
+  std::unique_ptr<char[]> overflow_;
+  alignas(Header) char inline_[kInlineBytes];
+};
+
+/// @brief Returns status contexts to their pool.
+struct StatusContextDeleter {
+  void operator()(StatusContext* ctx) const {
+    ObjectPool<StatusContext>::Global().Delete(ctx);
+  }
+};
+
+/// @brief Make a status context in the global pool of contexts.
+template <typename... Args>
+auto MakeStatusContext(Args&&... args)
+    -> std::unique_ptr<StatusContext, StatusContextDeleter> {
+  auto* ctx = ObjectPool<StatusContext>::Global().Make(std::forward<Args>(args)...);
+  if (ctx == nullptr) throw std::bad_alloc();
+  return std::unique_ptr<StatusContext, StatusContextDeleter>(ctx);
+}
+
+}  // namespace internal
+
+/**
+ * \brief The error category of Status<E> codes that are converted to std::error_code.
+ *
+ * The value of such an error code is the value of the enum plus one, because a value of
+ * zero means success. Converting the error code back into a Status<E> restores the
+ * original code.
+ */
+template <typename E>
+class StatusCategory : public std::error_category {
+ public:
+  [[nodiscard]] auto name() const noexcept -> const char* override {
+    return "putong::Status";
+  }
+  [[nodiscard]] auto message(int ev) const -> std::string override {
+    return "putong::Status error " + std::to_string(ev - 1);
+  }
+};
+
+/// @brief Return the error category of Status<E> codes.
+template <typename E>
+auto status_category() -> const std::error_category& {
+  static const StatusCategory<E> category;
+  return category;
+}
+
+/**
+ * \brief A status with an error code of enum type E and an optional message.
+ *
+ * String literal messages are interned in the global InternPool, so constructing the
+ * same error many times does not allocate after the first time. Messages that are built
+ * at run time, e.g. with a path or an id in them, are copied into immutable storage that
+ * is shared by the copies of a status and freed with the last one, so they cannot grow
+ * the pool without bound. They can still be interned explicitly with the InternedString
+ * constructor if they are drawn from a bounded set.
+ * Context that varies per error, such as file names or row numbers, can be added while
+ * the error travels up the stack using WithContext(). It is only rendered by msg().
+ *
+ * When PUTONG_STATUS_TRACE_DEPTH is non-zero, error constructors also record the raw
+ * return addresses of their origin. These are only symbolized when msg() is called.
+ *
+ * An error can also wrap an std::error_code, e.g. an errno value. Only the category and
+ * value are stored, so the description of the code is obtained from the category when
+ * msg() is called.
+ */
 template <typename E>
 class Status {
   static_assert(std::is_enum_v<E>);
 
  public:
   Status() = default;
-  Status(E code, std::string message)
-      : status_(StatusType::Error), err_(code), msg_(std::move(message)) {}
+  /// @brief Construct an error with a message that is copied into shared storage.
+  PUTONG_STATUS_ORIGIN Status(E code, std::string_view message)
+      : status_(StatusType::Error), err_(code), owned_(Own(message)) {
+    CaptureTrace();
+  }
+  /// @brief Construct an error with a string literal message, which is interned.
+  template <size_t N>
+  PUTONG_STATUS_ORIGIN Status(E code, const char (&message)[N])
+      : status_(StatusType::Error),
+        err_(code),
+        msg_(InternPool::Global().Intern(message)) {
+    CaptureTrace();
+  }
+  /// @brief Construct an error with a message in a mutable buffer, e.g. one filled by
+  /// snprintf(), which is copied up to the first null character like a string_view.
+  template <size_t N>
+  PUTONG_STATUS_ORIGIN Status(E code, char (&message)[N])
+      : status_(StatusType::Error),
+        err_(code),
+        owned_(Own(std::string_view(message, strnlen(message, N)))) {
+    CaptureTrace();
+  }
+  /// @brief Construct an error with an interned message.
+  PUTONG_STATUS_ORIGIN Status(E code, InternedString message)
+      : status_(StatusType::Error), err_(code), msg_(message) {
+    CaptureTrace();
+  }
+  /// @brief Construct an error that wraps an error code, with a message that is copied
+  /// into shared storage.
+  PUTONG_STATUS_ORIGIN Status(E code, std::error_code ec, std::string_view message = {})
+      : status_(StatusType::Error),
+        err_(code),
+        owned_(Own(message)),
+        cat_(&ec.category()),
+        sys_(ec.value()) {
+    CaptureTrace();
+  }
+
+  Status(const Status& other)
+      : status_(other.status_),
+        err_(other.err_),
+        msg_(other.msg_),
+        owned_(other.owned_),
+        cat_(other.cat_),
+        sys_(other.sys_) {
+    if (other.ctx_) ctx_ = internal::MakeStatusContext(*other.ctx_);
+#if PUTONG_STATUS_TRACE_DEPTH > 0
+    trace_ = other.trace_;
+#endif
+  }
+  Status(Status&& other) noexcept = default;
+  auto operator=(const Status& other) -> Status& {
+    if (this != &other) *this = Status(other);
+    return *this;
+  }
+  auto operator=(Status&& other) noexcept -> Status& = default;
 
   static auto OK() -> Status { return Status(); }
 
+  /**
+   * \brief Convert an std::error_code to a status.
+   *
+   * A zero error code results in an OK status. Codes obtained from error_code() of an
+   * unwrapped Status<E> convert back to their original code. Other codes are wrapped in
+   * an error with the supplied code.
+   */
+  PUTONG_STATUS_ORIGIN static auto FromErrorCode(std::error_code ec, E code) -> Status {
+    if (!ec) return Status();
+    if (ec.category() == status_category<E>()) {
+      return Status(static_cast<E>(ec.value() - 1), InternedString());
+    }
+    return Status(code, ec);
+  }
+
+  /// @brief Wrap an errno value in an error status with the supplied code.
+  PUTONG_STATUS_ORIGIN static auto FromErrno(E code, int errnum = errno,
+                                             std::string_view message = {}) -> Status {
+    return Status(code, std::error_code(errnum, std::generic_category()), message);
+  }
+
+  /**
+   * \brief Add a context frame to an error status. This has no effect on an OK status.
+   *
+   * Frames are rendered by msg() in front of the message, last added first, each followed
+   * by ": ". The first frame takes a context from a pool, later frames are amortized
+   * O(1).
+   */
+  auto WithContext(std::string_view frame) & -> Status& {
+    if (status_ == StatusType::OK) return *this;
+    if (!ctx_) ctx_ = internal::MakeStatusContext();
+    ctx_->Push(frame);
+    return *this;
+  }
+
+  /// @brief Add a context frame to an error status. This has no effect on an OK status.
+  auto WithContext(std::string_view frame) && -> Status&& {
+    return std::move(WithContext(frame));
+  }
+
   [[nodiscard]] auto ok() const -> bool { return status_ == StatusType::OK; }
-  [[nodiscard]] auto msg() const -> std::string { return msg_; }
+  [[nodiscard]] auto msg() const -> std::string {
+    std::string result;
+    if (ctx_) {
+      result.reserve(ctx_->chars() + ctx_->frames() * kSeparator.size() +
+                     message().size());
+      ctx_->ForEach([&](std::string_view frame) {
+        result.append(frame);
+        result.append(kSeparator);
+      });
+    }
+    result.append(message());
+    if (cat_ != nullptr) {
+      if (!message().empty()) result.append(kSeparator);
+      result.append(cat_->message(sys_));
+    }
+#if PUTONG_STATUS_TRACE_DEPTH > 0
+    if (trace_.size() > 0) {
+      result.append("\n");
+      result.append(trace_.str());
+    }
+#endif
+    return result;
+  }
+  /// @brief Return the message, without context frames and the wrapped error code.
+  [[nodiscard]] auto message() const -> std::string_view {
+    return owned_ ? std::string_view(*owned_) : msg_.view();
+  }
+  /// @brief Return the handle of the message if it is interned, or an empty handle if it
+  /// is not.
+  [[nodiscard]] auto msg_handle() const -> InternedString { return msg_; }
   [[nodiscard]] auto err() const -> E { return err_; }
 
+  /**
+   * \brief Return this status as an std::error_code.
+   *
+   * This returns the wrapped error code if there is one, the code of this status plus
+   * one in the category of status_category<E>() if there is not, or a zero error code if
+   * this status is OK.
+   */
+  [[nodiscard]] auto error_code() const -> std::error_code {
+    if (cat_ != nullptr) return {sys_, *cat_};
+    if (ok()) return {};
+    return {static_cast<int>(err_) + 1, status_category<E>()};
+  }
+
+#if PUTONG_STATUS_TRACE_DEPTH > 0
+  /// @brief Return the return addresses recorded when this error was created.
+  [[nodiscard]] auto trace() const -> const Backtrace<PUTONG_STATUS_TRACE_DEPTH>& {
+    return trace_;
+  }
+#endif
+
  private:
+  PUTONG_STATUS_ORIGIN void CaptureTrace() {
+#if PUTONG_STATUS_TRACE_DEPTH > 0
+    // This and the error constructors are inlined into the caller, so the noinline
+    // Capture() records the caller as frame 0.
+    trace_.Capture();
+#endif
+  }
+
+  static auto Own(std::string_view message) -> std::shared_ptr<const std::string> {
+    if (message.empty()) return nullptr;
+    return std::make_shared<const std::string>(message);
+  }
+
+  static constexpr std::string_view kSeparator = ": ";
+
   StatusType status_ = StatusType::OK;
-  E err_;
-  std::string msg_;
+  E err_{};
+  InternedString msg_;
+  std::shared_ptr<const std::string> owned_;
+  std::unique_ptr<internal::StatusContext, internal::StatusContextDeleter> ctx_;
+  const std::error_category* cat_ = nullptr;
+  int sys_ = 0;
+#if PUTONG_STATUS_TRACE_DEPTH > 0
+  Backtrace<PUTONG_STATUS_TRACE_DEPTH> trace_;
+#endif
 };
 
 }  // namespace putong
@@ -0,0 +1,215 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "putong/status.h"
+
+namespace putong {
+
+namespace internal {
+
+inline auto PopCount(uint64_t x) -> size_t {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<size_t>(__builtin_popcountll(x));
+#else
+  size_t n = 0;
+  for (; x != 0; x &= x - 1) n++;
+  return n;
+#endif
+}
+
+}  // namespace internal
+
+/**
+ * \brief Per-element outcomes of an operation over many elements.
+ *
+ * Failures are recorded in a bitmap with one bit per element, and in a sparse side table
+ * holding the error status of each failed element, including its context frames and
+ * wrapped error code. Successful elements cost nothing beyond their bit.
+ *
+ * Indices beyond the size of the batch do not exist: failures recorded for them are
+ * ignored, they are reported as OK, and ranges are cut off at the size.
+ */
+template <typename E>
+class StatusBatch {
+ public:
+  /// @brief A failed element.
+  struct Entry {
+    size_t index;
+    Status<E> status;
+  };
+
+  /// @brief Construct a new batch of size elements that are all OK.
+  explicit StatusBatch(size_t size = 0) : size_(size), bits_((size + 63) / 64, 0) {}
+
+  /// @brief Return the number of elements in the batch.
+  [[nodiscard]] auto size() const -> size_t { return size_; }
+
+  /// @brief Mark all elements as OK.
+  void Reset() {
+    std::fill(bits_.begin(), bits_.end(), 0);
+    errors_.clear();
+  }
+
+  /// @brief Record a failure of element i. Only the first failure of an element is kept.
+  void Fail(size_t i, E code, InternedString msg) {
+    if (ok(i)) Record(i, Status<E>(code, msg));
+  }
+
+  /// @brief Record a failure of element i. Only the first failure of an element is kept.
+  void Fail(size_t i, E code, std::string_view msg) {
+    if (ok(i)) Record(i, Status<E>(code, msg));
+  }
+
+  /// @brief Record a failure of element i with a string literal message, which is
+  /// interned. Only the first failure of an element is kept.
+  template <size_t N>
+  void Fail(size_t i, E code, const char (&msg)[N]) {
+    if (ok(i)) Record(i, Status<E>(code, msg));
+  }
+
+  /// @brief Record a failure of element i with a message in a mutable buffer, which is
+  /// copied. Only the first failure of an element is kept.
+  template <size_t N>
+  void Fail(size_t i, E code, char (&msg)[N]) {
+    if (ok(i)) Record(i, Status<E>(code, msg));
+  }
+
+  /// @brief Record the outcome of element i. Only the first failure of an element is
+  /// kept.
+  void Set(size_t i, Status<E> status) {
+    if (!status.ok() && ok(i)) Record(i, std::move(status));
+  }
+
+  /**
+   * \brief Record failures for up to 64 elements at once.
+   *
+   * Bit b of mask marks element word * 64 + b as failed. This allows validation kernels
+   * to produce a whole word of outcomes before touching the batch. Bits of elements
+   * beyond the size of the batch are ignored.
+   */
+  void FailMask(size_t word, uint64_t mask, E code, InternedString msg) {
+    if (word >= bits_.size()) return;
+    if (word == bits_.size() - 1 && size_ % 64 != 0) {
+      mask &= ~uint64_t{0} >> (64 - size_ % 64);
+    }
+    mask &= ~bits_[word];
+    if (mask == 0) return;
+    bits_[word] |= mask;
+    Status<E> status(code, msg);
+    for (; mask != 0; mask &= mask - 1) {
+      errors_.push_back({word * 64 + CountTrailingZeros(mask), status});
+    }
+  }
+
+  /// @brief Return true if element i is OK.
+  [[nodiscard]] auto ok(size_t i) const -> bool {
+    return i >= size_ || (bits_[i / 64] & (uint64_t{1} << (i % 64))) == 0;
+  }
+
+  /// @brief Return true if all elements are OK.
+  [[nodiscard]] auto all_ok() const -> bool { return errors_.empty(); }
+
+  /// @brief Return true if all elements in [begin, end) are OK.
+  [[nodiscard]] auto all_ok(size_t begin, size_t end) const -> bool {
+    uint64_t acc = 0;
+    ForEachWord(begin, end, [&](uint64_t w) { acc |= w; });
+    return acc == 0;
+  }
+
+  /// @brief Return the number of failed elements.
+  [[nodiscard]] auto count_errors() const -> size_t { return errors_.size(); }
+
+  /// @brief Return the number of failed elements in [begin, end).
+  [[nodiscard]] auto count_errors(size_t begin, size_t end) const -> size_t {
+    size_t count = 0;
+    ForEachWord(begin, end, [&](uint64_t w) { count += internal::PopCount(w); });
+    return count;
+  }
+
+  /// @brief Return the failure bitmap, with one bit per element and 64 elements per word.
+  [[nodiscard]] auto bitmap() const -> const std::vector<uint64_t>& { return bits_; }
+
+  /// @brief Return the failed elements, in the order in which they were recorded.
+  [[nodiscard]] auto errors() const -> const std::vector<Entry>& { return errors_; }
+
+  /**
+   * \brief Return OK if all elements are OK, or the error of the lowest failed index.
+   *
+   * The number of failed elements and the index of the reported one are added as context.
+   */
+  [[nodiscard]] auto ToStatus() const -> Status<E> {
+    if (errors_.empty()) return Status<E>::OK();
+    const Entry* first = &errors_[0];
+    for (const auto& e : errors_) {
+      if (e.index < first->index) first = &e;
+    }
+    return Status<E>(first->status)
+        .WithContext(std::to_string(errors_.size()) + " of " + std::to_string(size_) +
+                     " elements failed, first at index " + std::to_string(first->index));
+  }
+
+ private:
+  static auto CountTrailingZeros(uint64_t x) -> size_t {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<size_t>(__builtin_ctzll(x));
+#else
+    size_t n = 0;
+    while ((x & 1) == 0) {
+      x >>= 1;
+      n++;
+    }
+    return n;
+#endif
+  }
+
+  void Record(size_t i, Status<E> status) {
+    if (i >= size_) return;
+    bits_[i / 64] |= uint64_t{1} << (i % 64);
+    errors_.push_back({i, std::move(status)});
+  }
+
+  /// @brief Apply fn to all bitmap words overlapping [begin, end), masked to the range.
+  template <typename F>
+  void ForEachWord(size_t begin, size_t end, F&& fn) const {
+    end = std::min(end, size_);
+    if (begin >= end) return;
+    size_t first = begin / 64;
+    size_t last = (end - 1) / 64;
+    uint64_t head = ~uint64_t{0} << (begin % 64);
+    uint64_t tail = ~uint64_t{0} >> (63 - (end - 1) % 64);
+    if (first == last) {
+      fn(bits_[first] & head & tail);
+      return;
+    }
+    fn(bits_[first] & head);
+    for (size_t w = first + 1; w < last; w++) fn(bits_[w]);
+    fn(bits_[last] & tail);
+  }
+
+  size_t size_;
+  std::vector<uint64_t> bits_;
+  std::vector<Entry> errors_;
+};
+
+}  // namespace putong
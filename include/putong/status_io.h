@@ -0,0 +1,33 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <ostream>
+
+#include "putong/status.h"
+
+/// @file
+/// @brief Stream output of statuses, kept out of putong/status.h to avoid iostreams.
+
+namespace putong {
+
+/// @brief Print "OK", or the error code and message of a status on some output stream.
+template <typename E>
+auto operator<<(std::ostream& os, const Status<E>& status) -> std::ostream& {
+  if (status.ok()) return os << "OK";
+  return os << "Error " << static_cast<int>(status.err()) << ": " << status.msg();
+}
+
+}  // namespace putong
@@ -0,0 +1,124 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <thread>
+#endif
+
+#include "putong/cache_line.h"
+
+namespace putong {
+
+/**
+ * \brief Return a small number that identifies the calling thread, for striping.
+ *
+ * Threads are numbered round-robin in the order in which they first call this function,
+ * so threads that run concurrently tend to get different stripes.
+ */
+inline auto ThreadStripe() -> size_t {
+  static std::atomic<size_t> next = 0;
+  thread_local size_t stripe = next.fetch_add(1, std::memory_order_relaxed);
+  return stripe;
+}
+
+/// @brief Hint to the CPU that the calling thread is spinning on a shared variable.
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield" ::: "memory");
+#endif
+}
+
+/**
+ * \brief Block until the value at addr is no longer expected, or a spurious wake-up.
+ *
+ * On Linux, this is a private futex wait. Elsewhere, it yields once.
+ */
+inline void FutexWait(std::atomic<uint32_t>* addr, uint32_t expected) {
+#if defined(__linux__)
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT_PRIVATE, expected,
+          nullptr, nullptr, 0);
+#else
+  if (addr->load(std::memory_order_relaxed) == expected) std::this_thread::yield();
+#endif
+}
+
+/// @brief Wake up to n threads that wait on addr.
+inline void FutexWake(std::atomic<uint32_t>* addr, int n) {
+#if defined(__linux__)
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE_PRIVATE, n, nullptr,
+          nullptr, 0);
+#else
+  (void)addr;
+  (void)n;
+#endif
+}
+
+/**
+ * \brief An event count, to block threads until a condition on lock-free state holds.
+ *
+ * Waiters re-check the condition after announcing themselves, and notifiers only make a
+ * system call if a waiter has announced itself, so notifying without waiters costs a
+ * fence and a load.
+ */
+class EventCount {
+ public:
+  /// @brief Block until pred() returns true. pred() is not called again once it has
+  /// returned true, so it may consume the state it checks.
+  template <typename Pred>
+  void Await(Pred&& pred) {
+    if (pred()) return;
+    while (true) {
+      auto key = epoch_.load(std::memory_order_acquire);
+      waiters_.fetch_add(1, std::memory_order_seq_cst);
+      bool done = pred();
+      if (!done) FutexWait(&epoch_, key);
+      waiters_.fetch_sub(1, std::memory_order_relaxed);
+      if (done || pred()) return;
+    }
+  }
+
+  /// @brief Wake up all waiters, after the state their condition depends on changed.
+  void NotifyAll() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters_.load(std::memory_order_relaxed) == 0) return;
+    epoch_.fetch_add(1, std::memory_order_release);
+    FutexWake(&epoch_, INT32_MAX);
+  }
+
+  /// @brief Wake up one waiter, after the state their condition depends on changed.
+  void NotifyOne() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters_.load(std::memory_order_relaxed) == 0) return;
+    epoch_.fetch_add(1, std::memory_order_release);
+    FutexWake(&epoch_, 1);
+  }
+
+ private:
+  std::atomic<uint32_t> epoch_ = 0;
+  std::atomic<uint32_t> waiters_ = 0;
+};
+
+}  // namespace putong
@@ -0,0 +1,547 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "putong/cpu.h"
+#include "putong/histogram.h"
+#include "putong/object_pool.h"
+#include "putong/queue.h"
+#include "putong/status.h"
+#include "putong/sync.h"
+#include "putong/timer.h"
+
+namespace putong {
+
+enum class ThreadPoolError { OutOfMemory, Shutdown, Full };
+
+namespace internal {
+
+/**
+ * \brief A Chase-Lev work-stealing deque of pointers.
+ *
+ * The owner pushes and pops at the bottom, other threads steal from the top. This
+ * follows the C11 formulation of Lê et al. The array doubles when it is full. Old arrays
+ * are kept until the deque is destroyed, since a thief may still read from them.
+ */
+template <typename T>
+class WorkStealingDeque {
+ public:
+  explicit WorkStealingDeque(size_t capacity = 256) {
+    arrays_.push_back(std::make_unique<Array>(RoundUpToPowerOfTwo(capacity)));
+    array_.store(arrays_.back().get(), std::memory_order_relaxed);
+  }
+
+  WorkStealingDeque(const WorkStealingDeque&) = delete;
+  auto operator=(const WorkStealingDeque&) -> WorkStealingDeque& = delete;
+
+  /// @brief Push an item at the bottom. Owner only.
+  void Push(T* item) {
+    auto b = bottom_.load(std::memory_order_relaxed);
+    auto t = top_.load(std::memory_order_acquire);
+    auto* a = array_.load(std::memory_order_relaxed);
+    if (b - t > static_cast<int64_t>(a->mask)) a = Grow(a, t, b);
+    a->Put(b, item);
+    bottom_.store(b + 1, std::memory_order_release);
+  }
+
+  /// @brief Pop an item from the bottom, or return nullptr if empty. Owner only.
+  auto Pop() -> T* {
+    auto b = bottom_.load(std::memory_order_relaxed) - 1;
+    auto* a = array_.load(std::memory_order_relaxed);
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto t = top_.load(std::memory_order_relaxed);
+    if (t > b) {
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    T* item = a->Get(b);
+    if (t == b) {
+      // The last item, which a thief may be stealing concurrently.
+      if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)) {
+        item = nullptr;
+      }
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+  }
+
+  /// @brief Return the number of items, which may be stale if other threads steal.
+  [[nodiscard]] auto size() const -> size_t {
+    auto b = bottom_.load(std::memory_order_relaxed);
+    auto t = top_.load(std::memory_order_relaxed);
+    return b > t ? static_cast<size_t>(b - t) : 0;
+  }
+
+  /// @brief Steal an item from the top. Return nullptr if the deque is empty, or if
+  /// another thread took the item first.
+  auto Steal() -> T* {
+    auto t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto b = bottom_.load(std::memory_order_acquire);
+    if (t >= b) return nullptr;
+    T* item = array_.load(std::memory_order_acquire)->Get(t);
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return item;
+  }
+
+ private:
+  struct Array {
+    explicit Array(size_t capacity)
+        : mask(capacity - 1), items(std::make_unique<std::atomic<T*>[]>(capacity)) {}
+
+    auto Get(int64_t i) const -> T* {
+      return items[static_cast<size_t>(i) & mask].load(std::memory_order_relaxed);
+    }
+    void Put(int64_t i, T* item) {
+      items[static_cast<size_t>(i) & mask].store(item, std::memory_order_relaxed);
+    }
+
+    size_t mask;
+    std::unique_ptr<std::atomic<T*>[]> items;
+  };
+
+  auto Grow(Array* a, int64_t t, int64_t b) -> Array* {
+    arrays_.push_back(std::make_unique<Array>(2 * (a->mask + 1)));
+    auto* grown = arrays_.back().get();
+    for (auto i = t; i < b; i++) grown->Put(i, a->Get(i));
+    array_.store(grown, std::memory_order_release);
+    return grown;
+  }
+
+  alignas(kCacheLineSize) std::atomic<int64_t> top_ = 0;
+  alignas(kCacheLineSize) std::atomic<int64_t> bottom_ = 0;
+  std::atomic<Array*> array_;
+  std::vector<std::unique_ptr<Array>> arrays_;
+};
+
+}  // namespace internal
+
+/**
+ * \brief A work-stealing thread pool.
+ *
+ * Every worker owns a Chase-Lev deque and an MPSC inbox. Tasks submitted by a worker are
+ * pushed onto the deque of that worker, tasks submitted by other threads are spread
+ * round-robin over the inboxes. A worker runs tasks from its own deque first, then moves
+ * its inbox to its deque, and then tries to steal from the other workers, starting at a
+ * random victim. A worker that finds no work spins for a while, then yields for a while,
+ * and then parks on a futex until it is notified of new work.
+ *
+ * A worker also moves its inbox to its deque before it runs a task. Tasks that arrive in
+ * the inbox while the worker runs a task may be taken from the inbox by other workers,
+ * so they do not wait for a long task to finish while other workers are idle.
+ *
+ * Every worker records, for every task, the time from submission to start and the run
+ * time into its own histograms, which are merged by queue_wait() and run_time(). A
+ * growing queue wait with a stable run time shows that the pool is saturated.
+ *
+ * Tasks are allocated from an ObjectPool, so submitting does not allocate after warm-up
+ * unless the task does not fit the small buffer of std::function.
+ */
+class ThreadPool {
+ public:
+  /// @brief The capacity of the inbox of every worker.
+  static constexpr size_t kInboxCapacity = 1024;
+  /// @brief The number of attempts to find work while spinning, before yielding.
+  static constexpr int kSpins = 64;
+  /// @brief The number of attempts to find work while yielding, before parking.
+  static constexpr int kYields = 16;
+
+  /// @brief Start a pool with the given number of workers, at least one.
+  explicit ThreadPool(size_t num_threads = std::thread::hardware_concurrency()) {
+    Start(std::vector<int>(std::max<size_t>(num_threads, 1), -1));
+  }
+
+  /**
+   * \brief Start a pool with one worker per CPU, pinned to that CPU.
+   *
+   * Combined with CpusByNumaNode() and SubmitTo(), this keeps work that is placed on a
+   * range of workers on one NUMA node.
+   */
+  explicit ThreadPool(const std::vector<int>& cpus) {
+    Start(cpus.empty() ? std::vector<int>{-1} : cpus);
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  auto operator=(const ThreadPool&) -> ThreadPool& = delete;
+
+  ~ThreadPool() { Shutdown(); }
+
+  /// @brief Return the process-wide pool with one worker per CPU, pinned to the CPUs of
+  /// CpusByNumaNode(), which is never destroyed.
+  static auto Global() -> ThreadPool& {
+    static auto* pool = new ThreadPool(CpusByNumaNode());
+    return *pool;
+  }
+
+  /**
+   * \brief Submit a task.
+   *
+   * \param fn The task, a callable without arguments that must not throw.
+   * \return An error if the pool is shut down, unless called from a task of this pool,
+   *         if the task could not be allocated, or if all inboxes stayed full.
+   */
+  template <typename F>
+  auto Submit(F&& fn) -> Status<ThreadPoolError> {
+    auto* worker = current_;
+    if (worker != nullptr && worker->pool == this) {
+      auto* task = ObjectPool<Task>::Global().Make(std::forward<F>(fn));
+      if (task == nullptr) return OutOfMemory();
+      worker->deque.Push(task);
+      NotifyParked();
+      return Status<ThreadPoolError>::OK();
+    }
+
+    thread_local size_t next = ThreadStripe();
+    return SubmitToInbox(next++, std::forward<F>(fn));
+  }
+
+  /**
+   * \brief Submit a task to the inbox of a specific worker.
+   *
+   * The worker runs the task unless it is stolen after the worker moved it to its deque,
+   * or taken from the inbox by another worker while the worker is busy, so tasks that
+   * touch the same data can be placed on the same worker, or on workers of the same NUMA
+   * node. Unlike Submit(), this returns an error after shutdown even when
+   * called from a task.
+   *
+   * If all inboxes are full, a task of this pool pushes the task onto its own deque, so
+   * that workers that submit to each other cannot wait for each other forever. Other
+   * threads retry for a while and then return a Full error.
+   *
+   * \param worker The index of the worker, modulo the number of workers.
+   * \param fn The task, a callable without arguments that must not throw.
+   */
+  template <typename F>
+  auto SubmitTo(size_t worker, F&& fn) -> Status<ThreadPoolError> {
+    return SubmitToInbox(worker, std::forward<F>(fn));
+  }
+
+  /**
+   * \brief Run one pending task, if the calling thread is a worker of this pool and work
+   * is available. Return whether a task was run.
+   *
+   * This lets a task that waits for other tasks help to run them instead of blocking its
+   * worker.
+   */
+  auto TryRunOne() -> bool {
+    auto* w = current_;
+    if (w == nullptr || w->pool != this) return false;
+    auto* task = FindWork(w);
+    if (task == nullptr) return false;
+    Execute(w, task);
+    return true;
+  }
+
+  /**
+   * \brief Reject further submissions from outside the pool, run all submitted tasks, and
+   * join the workers. Must not be called from a task.
+   */
+  void Shutdown() {
+    std::lock_guard<std::mutex> lock(shutdown_mutex_);
+    stopping_.store(true, std::memory_order_seq_cst);
+    while (submitting_.load(std::memory_order_acquire) != 0) std::this_thread::yield();
+    done_.store(true, std::memory_order_release);
+    for (auto& w : workers_) w->wake.NotifyAll();
+    for (auto& w : workers_) {
+      if (w->thread.joinable()) w->thread.join();
+    }
+  }
+
+  /// @brief Return the number of workers.
+  [[nodiscard]] auto size() const -> size_t { return workers_.size(); }
+
+  /// @brief Return the index of the calling worker of this pool, or -1 if the calling
+  /// thread is not one of its workers.
+  [[nodiscard]] auto worker_index() const -> int {
+    auto* w = current_;
+    return w != nullptr && w->pool == this ? static_cast<int>(w->index) : -1;
+  }
+
+  /// @brief Return the number of tasks on the deque of the calling worker, which is
+  /// zero when they were all stolen, or zero if the calling thread is not a worker.
+  [[nodiscard]] auto local_backlog() const -> size_t {
+    auto* w = current_;
+    return w != nullptr && w->pool == this ? w->deque.size() : 0;
+  }
+
+  /// @brief Return the times from submission to start of all tasks, in nanoseconds.
+  [[nodiscard]] auto queue_wait() const -> Histogram {
+    Histogram result;
+    for (const auto& w : workers_) result.Merge(w->queue_wait);
+    return result;
+  }
+
+  /// @brief Return the run times of all tasks, in nanoseconds.
+  [[nodiscard]] auto run_time() const -> Histogram {
+    Histogram result;
+    for (const auto& w : workers_) result.Merge(w->run_time);
+    return result;
+  }
+
+  /// @brief Return the number of tasks that were stolen from another worker.
+  [[nodiscard]] auto steals() const -> uint64_t {
+    uint64_t result = 0;
+    for (const auto& w : workers_) result += w->steals.load(std::memory_order_relaxed);
+    return result;
+  }
+
+ private:
+  struct Task {
+    template <typename F>
+    explicit Task(F&& f) : fn(std::forward<F>(f)), timer(true) {}
+
+    std::function<void()> fn;
+    /// Started on submission, and restarted when the task runs.
+    Timer<> timer;
+  };
+
+  struct alignas(kCacheLineSize) Worker {
+    Worker(ThreadPool* pool, size_t index, int cpu)
+        : pool(pool), index(index), cpu(cpu), inbox(kInboxCapacity), rng(index * 2 + 1) {}
+
+    ThreadPool* pool;
+    size_t index;
+    int cpu;
+    internal::WorkStealingDeque<Task> deque;
+    MpscQueue<Task*> inbox;
+    /// Held by the thread that pops the inbox, since it has a single consumer at a time.
+    std::atomic<bool> inbox_claimed = false;
+    /// Set while the worker runs a task, when it does not look at its inbox.
+    std::atomic<bool> busy = false;
+    EventCount wake;
+    std::atomic<bool> parked = false;
+    std::atomic<uint64_t> steals = 0;
+    uint64_t rng;
+    Histogram queue_wait;
+    Histogram run_time;
+    std::thread thread;
+  };
+
+  static auto OutOfMemory() -> Status<ThreadPoolError> {
+    return Status<ThreadPoolError>(ThreadPoolError::OutOfMemory,
+                                   "unable to allocate task");
+  }
+
+  void Start(const std::vector<int>& cpus) {
+    for (size_t i = 0; i < cpus.size(); i++) {
+      workers_.push_back(std::make_unique<Worker>(this, i, cpus[i]));
+    }
+    for (auto& w : workers_) w->thread = std::thread(&ThreadPool::Run, this, w.get());
+  }
+
+  template <typename F>
+  auto SubmitToInbox(size_t index, F&& fn) -> Status<ThreadPoolError> {
+    submitting_.fetch_add(1, std::memory_order_seq_cst);
+    if (stopping_.load(std::memory_order_seq_cst)) {
+      submitting_.fetch_sub(1, std::memory_order_release);
+      return Status<ThreadPoolError>(ThreadPoolError::Shutdown,
+                                     "thread pool is shut down");
+    }
+    auto* task = ObjectPool<Task>::Global().Make(std::forward<F>(fn));
+    if (task == nullptr) {
+      submitting_.fetch_sub(1, std::memory_order_release);
+      return OutOfMemory();
+    }
+    // Try the next inboxes if the inbox is full. Once all of them are, a worker of this
+    // pool keeps the task, since the workers may all be waiting for each other's inbox.
+    // Other threads yield to let the workers drain their inboxes, for a while.
+    auto num = workers_.size();
+    auto* worker = current_;
+    bool pushed = false;
+    for (size_t attempt = 0; attempt < num * (kYields + 1); attempt++) {
+      auto& target = *workers_[(index + attempt) % num];
+      if (target.inbox.TryPush(task)) {
+        target.wake.NotifyOne();
+        // A busy worker does not look at its inbox until its task returns, so wake
+        // another worker to take the task. This pairs with the fence in Execute().
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (target.busy.load(std::memory_order_relaxed)) NotifyParked();
+        pushed = true;
+        break;
+      }
+      if ((attempt + 1) % num != 0) continue;
+      if (worker != nullptr && worker->pool == this) {
+        worker->deque.Push(task);
+        NotifyParked();
+        pushed = true;
+        break;
+      }
+      std::this_thread::yield();
+    }
+    submitting_.fetch_sub(1, std::memory_order_release);
+    if (!pushed) {
+      ObjectPool<Task>::Global().Delete(task);
+      return Status<ThreadPoolError>(ThreadPoolError::Full,
+                                     "thread pool inboxes are full");
+    }
+    return Status<ThreadPoolError>::OK();
+  }
+
+  void Run(Worker* w) {
+    current_ = w;
+    if (w->cpu >= 0) PinThisThread(w->cpu);
+    while (true) {
+      auto* task = FindWork(w);
+      if (task == nullptr) task = Idle(w);
+      if (task == nullptr) break;
+      Execute(w, task);
+    }
+    current_ = nullptr;
+  }
+
+  void Execute(Worker* w, Task* task) {
+    // Mark the worker busy, and then move its inbox to its deque, where other workers
+    // can steal it. A task that is pushed to the inbox after this is either moved too, or
+    // its submitter sees that the worker is busy.
+    bool was_busy = w->busy.load(std::memory_order_relaxed);
+    w->busy.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    Task* batch[32];
+    size_t n = 0;
+    bool claimed = PopInbox(w, batch, 32, &n);
+    for (size_t i = n; i > 0; i--) w->deque.Push(batch[i - 1]);
+    if (n > 0 || !claimed) NotifyParked();
+
+    task->timer.Stop();
+    w->queue_wait.Record(task->timer);
+    task->timer.Start();
+    task->fn();
+    task->timer.Stop();
+    w->run_time.Record(task->timer);
+    ObjectPool<Task>::Global().Delete(task);
+    w->busy.store(was_busy, std::memory_order_relaxed);
+  }
+
+  /// Pop up to max tasks from the inbox of a worker into out, and store their number in
+  /// n. Return false, without popping, if another thread is popping the inbox.
+  static auto PopInbox(Worker* w, Task** out, size_t max, size_t* n) -> bool {
+    *n = 0;
+    if (w->inbox_claimed.load(std::memory_order_relaxed) ||
+        w->inbox_claimed.exchange(true, std::memory_order_acquire)) {
+      return false;
+    }
+    *n = w->inbox.TryPopBatch(out, max);
+    w->inbox_claimed.store(false, std::memory_order_release);
+    return true;
+  }
+
+  auto FindWork(Worker* w) -> Task* {
+    if (auto* task = w->deque.Pop()) return task;
+
+    Task* batch[32];
+    size_t n = 0;
+    if (PopInbox(w, batch, 32, &n) && n > 0) {
+      // Move the rest of the inbox to the deque, where other workers can steal it.
+      for (size_t i = n - 1; i > 0; i--) w->deque.Push(batch[i]);
+      if (n > 1) NotifyParked();
+      return batch[0];
+    }
+
+    auto num = workers_.size();
+    if (num == 1) return nullptr;
+    // A xorshift generator to pick the first victim.
+    w->rng ^= w->rng << 13;
+    w->rng ^= w->rng >> 7;
+    w->rng ^= w->rng << 17;
+    auto first = static_cast<size_t>(w->rng % num);
+    for (size_t i = 0; i < num; i++) {
+      auto& victim = *workers_[(first + i) % num];
+      if (&victim == w) continue;
+      if (auto* task = victim.deque.Steal()) {
+        w->steals.fetch_add(1, std::memory_order_relaxed);
+        return task;
+      }
+    }
+    // Take a task from the inbox of a busy worker. The inboxes of idle workers are left
+    // alone, so that tasks submitted to a worker run on it when it is free.
+    for (size_t i = 0; i < num; i++) {
+      auto& victim = *workers_[(first + i) % num];
+      if (&victim == w || !victim.busy.load(std::memory_order_relaxed)) continue;
+      if (PopInbox(&victim, batch, 1, &n) && n > 0) {
+        w->steals.fetch_add(1, std::memory_order_relaxed);
+        return batch[0];
+      }
+    }
+    return nullptr;
+  }
+
+  /// Spin, yield and then park until work is found, or return nullptr when done.
+  auto Idle(Worker* w) -> Task* {
+    for (int i = 0; i < kSpins + kYields; i++) {
+      if (i < kSpins) {
+        CpuRelax();
+      } else {
+        std::this_thread::yield();
+      }
+      Task* task = nullptr;
+      if (FindWorkOrDone(w, &task)) return task;
+    }
+    Task* task = nullptr;
+    // Announce parking before the last search, so that a thread that pushes work after
+    // the search sees the announcement and wakes this worker.
+    num_parked_.fetch_add(1, std::memory_order_seq_cst);
+    w->parked.store(true, std::memory_order_seq_cst);
+    w->wake.Await([&] { return FindWorkOrDone(w, &task); });
+    w->parked.store(false, std::memory_order_relaxed);
+    num_parked_.fetch_sub(1, std::memory_order_relaxed);
+    return task;
+  }
+
+  /// Find work, and return true if work was found or if the pool is done.
+  auto FindWorkOrDone(Worker* w, Task** task) -> bool {
+    // Check for shutdown first, so that all tasks submitted before it are found.
+    bool done = done_.load(std::memory_order_acquire);
+    *task = FindWork(w);
+    return *task != nullptr || done;
+  }
+
+  /// Wake one parked worker, if any, to steal work that was pushed onto a deque.
+  void NotifyParked() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (num_parked_.load(std::memory_order_relaxed) == 0) return;
+    for (auto& w : workers_) {
+      if (w->parked.load(std::memory_order_relaxed)) {
+        w->wake.NotifyOne();
+        return;
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<bool> stopping_ = false;
+  std::atomic<bool> done_ = false;
+  std::atomic<size_t> submitting_ = 0;
+  alignas(kCacheLineSize) std::atomic<size_t> num_parked_ = 0;
+  std::mutex shutdown_mutex_;
+  static inline thread_local Worker* current_ = nullptr;
+};
+
+}  // namespace putong
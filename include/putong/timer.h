@@ -16,18 +16,73 @@
 
 #include <atomic>
 #include <chrono>
-#include <iomanip>
-#include <iostream>
-#include <sstream>
+#include <cstdint>
+#include <ratio>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 namespace putong {
 
+namespace internal {
+
+/**
+ * \brief Integer conversion of clock ticks with the given period.
+ *
+ * Ticks are converted to nanoseconds with integer arithmetic only. The whole part of the
+ * ratio of nanoseconds per tick is an integer multiplier, and its fraction is a
+ * precomputed 0.64 fixed-point multiplier that is applied with a single 64x64-bit
+ * multiplication and a shift. The fraction is rounded up, so the result is exact up to
+ * truncation of the final fraction of a nanosecond for intervals of less than 2^64 / den
+ * ticks, and within a nanosecond beyond that. Seconds are derived from the nanoseconds
+ * for display only.
+ */
+template <typename Period>
+struct Ticks {
+  using to_ns = std::ratio_divide<Period, std::nano>;
+
+  static constexpr auto nanoseconds(int64_t ticks) -> int64_t {
+    if constexpr (to_ns::den == 1) {
+      return ticks * to_ns::num;
+    } else {
+      auto magnitude = static_cast<uint64_t>(ticks);
+      if (ticks < 0) magnitude = -magnitude;
+      auto ns = static_cast<int64_t>(magnitude * kWhole + Fraction(magnitude));
+      return ticks < 0 ? -ns : ns;
+    }
+  }
+
+  static constexpr auto seconds(int64_t ticks) -> double {
+    return static_cast<double>(nanoseconds(ticks)) / 1e9;
+  }
+
+ private:
+  static constexpr uint64_t kWhole = to_ns::num / to_ns::den;
+  static constexpr uint64_t kRemainder = to_ns::num % to_ns::den;
+
+  /// Return floor(magnitude * kRemainder / den), up to the rounding described above.
+  static constexpr auto Fraction(uint64_t magnitude) -> uint64_t {
+#if defined(__SIZEOF_INT128__)
+    __extension__ typedef unsigned __int128 uint128;
+    // The remainder as a fixed-point fraction of 2^64, rounded up.
+    constexpr auto multiplier = static_cast<uint64_t>(
+        ((uint128{kRemainder} << 64) + to_ns::den - 1) / to_ns::den);
+    return static_cast<uint64_t>((uint128{magnitude} * multiplier) >> 64);
+#else
+    // Split off whole multiples of the denominator, so the product cannot overflow.
+    return magnitude / to_ns::den * kRemainder +
+           magnitude % to_ns::den * kRemainder / to_ns::den;
+#endif
+  }
+};
+
+}  // namespace internal
+
 /// @brief An std::chrono-based timer wrapper.
 template <typename clock = std::chrono::steady_clock>
 struct Timer {
   using ns = std::chrono::nanoseconds;
-  using point = std::chrono::time_point<clock, ns>;
+  using point = typename clock::time_point;
   using duration = std::chrono::duration<double>;
 
   /// @brief Construct a new timer. This also starts the timer if start=true.
@@ -61,24 +116,19 @@ struct Timer {
   /// @brief Stop the timer.
   inline void Stop() { stop_ = clock::now(); }
 
-  /// @brief Retrieve the interval in seconds.
-  [[nodiscard]] inline auto seconds() const -> double {
-    duration diff = stop_ - start_;
-    return diff.count();
+  /// @brief Retrieve the interval in ticks of the clock.
+  [[nodiscard]] inline auto ticks() const -> int64_t {
+    return static_cast<int64_t>((stop_ - start_).count());
   }
 
-  /// @brief Return the interval in seconds as a formatted string.
-  [[nodiscard]] inline auto str(int width = 14) const -> std::string {
-    std::stringstream ss;
-    ss << std::setprecision(width - 5) << std::setw(width) << std::fixed << seconds();
-    return ss.str();
+  /// @brief Retrieve the interval in nanoseconds.
+  [[nodiscard]] inline auto nanoseconds() const -> int64_t {
+    return internal::Ticks<typename clock::period>::nanoseconds(ticks());
   }
 
-  /// @brief Print the interval on some output stream
-  inline void report(std::ostream& os = std::cout, bool last = false,
-                     int width = 15) const {
-    os << std::setw(width) << ((last ? " " : "") + str() + (last ? "\n" : ","))
-       << std::flush;
+  /// @brief Retrieve the interval in seconds.
+  [[nodiscard]] inline auto seconds() const -> double {
+    return internal::Ticks<typename clock::period>::seconds(ticks());
   }
 };
 
@@ -88,7 +138,7 @@ struct SplitTimer {
   static_assert(num_splits > 0);
 
   using ns = std::chrono::nanoseconds;
-  using point = std::chrono::time_point<clock, ns>;
+  using point = typename clock::time_point;
   using duration = std::chrono::duration<double>;
 
   point splits[num_splits + 1];
@@ -150,28 +200,30 @@ struct SplitTimer {
     splits[idx] = clock::now();
   }
 
+  /// @brief Retrieve split interval i in ticks of the clock.
+  [[nodiscard]] inline auto ticks(size_t i) const -> int64_t {
+    return static_cast<int64_t>((splits[i + 1] - splits[i]).count());
+  }
+
+  /// @brief Retrieve split interval i in nanoseconds.
+  [[nodiscard]] inline auto nanoseconds(size_t i) const -> int64_t {
+    return internal::Ticks<typename clock::period>::nanoseconds(ticks(i));
+  }
+
+  /// @brief Retrieve the total of all split intervals in nanoseconds.
+  [[nodiscard]] inline auto total_nanoseconds() const -> int64_t {
+    return internal::Ticks<typename clock::period>::nanoseconds(
+        static_cast<int64_t>((splits[num_splits] - splits[0]).count()));
+  }
+
   /// @brief Retrieve the split intervals in seconds.
   [[nodiscard]] inline auto seconds() const -> std::vector<double> {
     std::vector<double> result;
-    for (size_t i = 1; i < num_splits + 1; i++) {
-      duration diff = splits[i] - splits[i - 1];
-      result.push_back(diff.count());
+    for (size_t i = 0; i < num_splits; i++) {
+      result.push_back(internal::Ticks<typename clock::period>::seconds(ticks(i)));
     }
     return result;
   }
-
-  /// @brief Push comma separated intervals in seconds onto some stream as strings
-  inline void report(std::ostream& os = std::cout, int precision = 15) const {
-    auto intervals = seconds();
-    for (int i = 0; i < intervals.size(); i++) {
-      if (i < intervals.size() - 1) {
-        os << std::setprecision(precision) << intervals[i] << ",";
-      } else {
-        os << std::setprecision(precision) << intervals[i];
-      }
-    }
-    os << std::flush;
-  }
 };
 
 }  // namespace putong
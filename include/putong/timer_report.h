@@ -0,0 +1,108 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "putong/alloc.h"
+#include "putong/dual_timer.h"
+#include "putong/sched_timer.h"
+#include "putong/timer.h"
+
+/// @file
+/// @brief Stream-based reporting of timers.
+///
+/// This is kept out of putong/timer.h, so that code that only measures time does not
+/// need to include iostreams.
+
+namespace putong {
+
+/// @brief Return the interval of a timer in seconds as a formatted string.
+template <typename clock>
+auto str(const Timer<clock>& timer, int width = 14) -> std::string {
+  std::stringstream ss;
+  ss << std::setprecision(width - 5) << std::setw(width) << std::fixed << timer.seconds();
+  return ss.str();
+}
+
+/// @brief Print the interval of a timer on some output stream.
+template <typename clock>
+void report(const Timer<clock>& timer, std::ostream& os = std::cout, bool last = false,
+            int width = 15) {
+  os << std::setw(width) << ((last ? " " : "") + str(timer) + (last ? "\n" : ","))
+     << std::flush;
+}
+
+/// @brief Push comma separated split intervals in seconds onto some stream as strings.
+template <unsigned int num_splits, typename clock>
+void report(const SplitTimer<num_splits, clock>& timer, std::ostream& os = std::cout,
+            int precision = 15) {
+  auto intervals = timer.seconds();
+  for (size_t i = 0; i < intervals.size(); i++) {
+    if (i < intervals.size() - 1) {
+      os << std::setprecision(precision) << intervals[i] << ",";
+    } else {
+      os << std::setprecision(precision) << intervals[i];
+    }
+  }
+  os << std::flush;
+}
+
+/// @brief Push comma separated time in seconds, allocations and allocated bytes of every
+/// split interval onto some stream as strings.
+template <unsigned int num_splits, typename clock>
+void report(const AllocTimer<num_splits, clock>& timer, std::ostream& os = std::cout,
+            int precision = 15) {
+  auto time = timer.time.seconds();
+  os << std::setprecision(precision);
+  for (size_t i = 0; i < num_splits; i++) {
+    if (i > 0) os << ",";
+    os << time[i] << "," << timer.allocations(i) << "," << timer.bytes(i);
+  }
+  os << std::flush;
+}
+
+#if defined(__linux__)
+/// @brief Push comma separated wall time in seconds, CPU time in seconds and their ratio
+/// of every split interval onto some stream as strings.
+template <unsigned int num_splits, typename wall_clock, typename cpu_clock>
+void report(const DualTimer<num_splits, wall_clock, cpu_clock>& timer,
+            std::ostream& os = std::cout, int precision = 15) {
+  auto wall = timer.wall.seconds();
+  auto cpu = timer.cpu.seconds();
+  os << std::setprecision(precision);
+  for (size_t i = 0; i < num_splits; i++) {
+    if (i > 0) os << ",";
+    os << wall[i] << "," << cpu[i] << "," << timer.ratio(i);
+  }
+  os << std::flush;
+}
+
+/// @brief Push comma separated interval, run time, runqueue time and blocked time in
+/// seconds, and the voluntary and involuntary context switches onto some stream.
+template <typename clock>
+void report(const SchedTimer<clock>& timer, std::ostream& os = std::cout,
+            int precision = 15) {
+  os << std::setprecision(precision) << timer.seconds() << ","
+     << timer.run_nanoseconds() * 1e-9 << "," << timer.runqueue_nanoseconds() * 1e-9
+     << "," << timer.blocked_nanoseconds() * 1e-9 << "," << timer.voluntary_switches()
+     << "," << timer.involuntary_switches() << std::flush;
+}
+#endif
+
+}  // namespace putong
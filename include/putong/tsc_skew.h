@@ -0,0 +1,246 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "putong/clock.h"
+#include "putong/cpu.h"
+
+#if PUTONG_HAS_TSC
+
+namespace putong {
+
+namespace internal {
+
+/// @brief Return true if the CPU supports the rdtscp instruction.
+inline auto HasRdtscp() -> bool {
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if (__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) == 0) return false;
+  return (edx & (1u << 27)) != 0;
+}
+
+}  // namespace internal
+
+/**
+ * \brief A table of TSC offsets of all CPUs, relative to the first online CPU.
+ *
+ * The offsets are measured by ping-pong between a thread pinned to the reference CPU and
+ * a thread pinned to each other CPU. In every round, the reference thread reads its TSC
+ * before and after the other thread reads its TSC. The round with the shortest round trip
+ * bounds the offset most tightly, and the offset is estimated as the difference between
+ * the remote reading and the midpoint of the reference readings.
+ */
+class TscSkew {
+ public:
+  /// @brief A TSC reading and the CPU it was taken on.
+  struct Reading {
+    uint64_t tsc;
+    int cpu;
+  };
+
+  /// @brief Measure the offsets of all online CPUs with the given number of rounds each.
+  static auto Measure(int rounds = 2000) -> TscSkew {
+    TscSkew result;
+    auto cpus = OnlineCpus();
+    auto max_cpu = *std::max_element(cpus.begin(), cpus.end());
+    result.offsets_.assign(max_cpu + 1, 0);
+    result.uncertainty_.assign(max_cpu + 1, std::numeric_limits<uint64_t>::max());
+    result.uncertainty_[cpus.front()] = 0;
+    for (size_t i = 1; i < cpus.size(); i++) {
+      MeasurePair(cpus.front(), cpus[i], rounds, &result.offsets_[cpus[i]],
+                  &result.uncertainty_[cpus[i]]);
+    }
+    return result;
+  }
+
+  /// @brief Return the offsets of the host, measuring them on first use.
+  static auto Global() -> const TscSkew& {
+    static const TscSkew skew = Measure();
+    return skew;
+  }
+
+  /**
+   * \brief Read the TSC and the id of the CPU it was read on.
+   *
+   * This uses rdtscp, which returns both atomically. On Linux, the lower 12 bits of its
+   * auxiliary value hold the CPU id. Without rdtscp, the CPU is queried separately, so
+   * the thread may migrate between the two reads.
+   */
+  static auto Read() -> Reading {
+    static const bool rdtscp = internal::HasRdtscp();
+    if (rdtscp) {
+      unsigned int aux = 0;
+      uint64_t tsc = __rdtscp(&aux);
+      return {tsc, static_cast<int>(aux & 0xfff)};
+    }
+    return {internal::ReadTsc(), CurrentCpu()};
+  }
+
+  /// @brief Return the offset of the TSC of a CPU relative to the reference CPU.
+  [[nodiscard]] auto offset(int cpu) const -> int64_t {
+    return cpu >= 0 && static_cast<size_t>(cpu) < offsets_.size() ? offsets_[cpu] : 0;
+  }
+
+  /// @brief Return whether the offset of a CPU was measured. It is not if a thread could
+  /// not be pinned to it, e.g. because the process may not run on it.
+  [[nodiscard]] auto measured(int cpu) const -> bool {
+    return uncertainty(cpu) != std::numeric_limits<uint64_t>::max();
+  }
+
+  /// @brief Return the round trip bounding the offset of a CPU in ticks, or the maximum
+  /// value if it was not measured.
+  [[nodiscard]] auto uncertainty(int cpu) const -> uint64_t {
+    return cpu >= 0 && static_cast<size_t>(cpu) < uncertainty_.size()
+               ? uncertainty_[cpu]
+               : std::numeric_limits<uint64_t>::max();
+  }
+
+  /// @brief Return the largest absolute offset of any CPU, in ticks.
+  [[nodiscard]] auto max_skew() const -> uint64_t {
+    uint64_t result = 0;
+    for (auto o : offsets_) result = std::max<uint64_t>(result, o < 0 ? -o : o);
+    return result;
+  }
+
+  /// @brief Return a reading converted to the time base of the reference CPU.
+  [[nodiscard]] auto Correct(Reading r) const -> uint64_t {
+    return r.tsc - offset(r.cpu);
+  }
+
+ private:
+  /// Measure the offset of remote, unless either thread cannot be pinned. Unpinned
+  /// threads would sample arbitrary CPUs, so the pair is then left unmeasured.
+  static void MeasurePair(int reference, int remote, int rounds, int64_t* offset,
+                          uint64_t* uncertainty) {
+    std::atomic<int> seq = 0;
+    std::atomic<uint64_t> remote_tsc = 0;
+    std::atomic<int> ready = 0;
+    std::atomic<bool> failed = false;
+    // Return true if both threads are pinned.
+    auto pin = [&](int cpu) {
+      if (!PinThisThread(cpu)) failed.store(true, std::memory_order_relaxed);
+      ready.fetch_add(1, std::memory_order_acq_rel);
+      while (ready.load(std::memory_order_acquire) < 2) std::this_thread::yield();
+      return !failed.load(std::memory_order_relaxed);
+    };
+
+    std::thread other([&] {
+      if (!pin(remote)) return;
+      for (int r = 0; r < rounds; r++) {
+        while (seq.load(std::memory_order_acquire) != 2 * r + 1) {
+        }
+        remote_tsc.store(internal::ReadTsc(), std::memory_order_relaxed);
+        seq.store(2 * r + 2, std::memory_order_release);
+      }
+    });
+    std::thread self([&] {
+      if (!pin(reference)) return;
+      for (int r = 0; r < rounds; r++) {
+        auto t0 = internal::ReadTsc();
+        seq.store(2 * r + 1, std::memory_order_release);
+        while (seq.load(std::memory_order_acquire) != 2 * r + 2) {
+        }
+        auto t2 = internal::ReadTsc();
+        auto t1 = remote_tsc.load(std::memory_order_relaxed);
+        if (t2 - t0 < *uncertainty) {
+          *uncertainty = t2 - t0;
+          *offset = static_cast<int64_t>(t1 - (t0 + (t2 - t0) / 2));
+        }
+      }
+    });
+    self.join();
+    other.join();
+  }
+
+  std::vector<int64_t> offsets_;
+  std::vector<uint64_t> uncertainty_;
+};
+
+/**
+ * \brief A clock reading the TSC, corrected for the skew of the CPU it was read on.
+ *
+ * The correction table is measured on first use, see TscSkew::Global().
+ */
+struct corrected_tsc_clock {
+  using rep = int64_t;
+  using period = std::nano;
+  using duration = std::chrono::nanoseconds;
+  using time_point = std::chrono::time_point<corrected_tsc_clock>;
+  static constexpr bool is_steady = true;
+
+  static auto now() noexcept -> time_point {
+    auto ticks = TscSkew::Global().Correct(TscSkew::Read());
+    return time_point(tsc_clock::from_ticks(ticks).time_since_epoch());
+  }
+};
+
+/**
+ * \brief A TSC-based timer that corrects for skew and detects migrations.
+ *
+ * Both ends of the interval record the CPU they were taken on. Intervals whose ends were
+ * taken on different CPUs are corrected using the skew table and flagged by
+ * crossed_cores(), because their accuracy is limited by uncertainty().
+ */
+struct TscTimer {
+  explicit TscTimer(bool start = false) {
+    if (start) Start();
+  }
+
+  TscSkew::Reading start_{};
+  TscSkew::Reading stop_{};
+
+  inline void Start() { start_ = TscSkew::Read(); }
+  inline void Stop() { stop_ = TscSkew::Read(); }
+
+  /// @brief Return true if the interval started and stopped on different CPUs.
+  [[nodiscard]] inline auto crossed_cores() const -> bool {
+    return start_.cpu != stop_.cpu;
+  }
+
+  /// @brief Return the combined uncertainty of the correction, in ticks.
+  [[nodiscard]] inline auto uncertainty() const -> uint64_t {
+    if (!crossed_cores()) return 0;
+    const auto& skew = TscSkew::Global();
+    return skew.uncertainty(start_.cpu) / 2 + skew.uncertainty(stop_.cpu) / 2;
+  }
+
+  /// @brief Return the corrected interval in ticks.
+  [[nodiscard]] inline auto ticks() const -> int64_t {
+    if (!crossed_cores()) return static_cast<int64_t>(stop_.tsc - start_.tsc);
+    const auto& skew = TscSkew::Global();
+    return static_cast<int64_t>(skew.Correct(stop_) - skew.Correct(start_));
+  }
+
+  /// @brief Return the corrected interval in nanoseconds.
+  [[nodiscard]] inline auto nanoseconds() const -> int64_t {
+    auto t = ticks();
+    auto ns = tsc_clock::from_ticks(t < 0 ? -t : t).time_since_epoch().count();
+    return t < 0 ? -ns : ns;
+  }
+
+  /// @brief Return the corrected interval in seconds.
+  [[nodiscard]] inline auto seconds() const -> double { return nanoseconds() * 1e-9; }
+};
+
+}  // namespace putong
+
+#endif
@@ -0,0 +1,258 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "putong/timer.h"
+
+namespace putong {
+
+namespace internal {
+
+/// @brief A node in the call tree of a single thread.
+struct ZoneNode {
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  ZoneNode(const char* label, uint32_t parent) : label(label), parent(parent) {}
+
+  const char* label;
+  uint32_t parent;
+  std::atomic<uint32_t> first_child = kNone;
+  std::atomic<uint32_t> next_sibling = kNone;
+  std::atomic<int64_t> inclusive_ns = 0;
+  std::atomic<int64_t> children_ns = 0;
+  std::atomic<uint64_t> count = 0;
+};
+
+/**
+ * \brief The call tree of a single thread.
+ *
+ * Only the owning thread enters and exits zones. Counters are atomic so that they can be
+ * read while the owner is running, and the node storage is protected by a mutex that the
+ * owner only takes when it enters a zone for the first time.
+ */
+struct ZoneTree {
+  using clock = std::chrono::steady_clock;
+
+  struct Frame {
+    uint32_t node;
+    Timer<clock> timer;
+  };
+
+  ZoneTree() {
+    nodes.emplace_back(nullptr, ZoneNode::kNone);
+    stack.reserve(64);
+  }
+
+  /// @brief Return the child of parent with the given label, creating it if required.
+  auto Child(uint32_t parent, const char* label) -> uint32_t {
+    auto& p = nodes[parent];
+    for (auto c = p.first_child.load(std::memory_order_relaxed); c != ZoneNode::kNone;
+         c = nodes[c].next_sibling.load(std::memory_order_relaxed)) {
+      if (nodes[c].label == label) return c;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    auto idx = static_cast<uint32_t>(nodes.size());
+    auto& node = nodes.emplace_back(label, parent);
+    node.next_sibling.store(p.first_child.load(std::memory_order_relaxed),
+                            std::memory_order_relaxed);
+    p.first_child.store(idx, std::memory_order_release);
+    return idx;
+  }
+
+  void Enter(const char* label) {
+    auto parent = stack.empty() ? 0 : stack.back().node;
+    stack.push_back({Child(parent, label), Timer<clock>()});
+    stack.back().timer.Start();
+  }
+
+  void Exit() {
+    auto& frame = stack.back();
+    frame.timer.Stop();
+    auto ns = frame.timer.nanoseconds();
+    auto& node = nodes[frame.node];
+    node.inclusive_ns.fetch_add(ns, std::memory_order_relaxed);
+    node.count.fetch_add(1, std::memory_order_relaxed);
+    nodes[node.parent].children_ns.fetch_add(ns, std::memory_order_relaxed);
+    stack.pop_back();
+  }
+
+  std::mutex mutex;
+  std::deque<ZoneNode> nodes;
+  std::vector<Frame> stack;
+};
+
+}  // namespace internal
+
+/**
+ * \brief A hierarchical profiler of nested, timed zones.
+ *
+ * Every thread records into its own call tree, in which the children of a zone are keyed
+ * by the address of their label. Labels must therefore be string literals or otherwise
+ * outlive the profiler. Trees of all threads are merged on demand by Collect().
+ */
+class ZoneProfiler {
+ public:
+  /// @brief A node of the merged call tree.
+  struct Node {
+    const char* label;
+    /// Index of the parent node, or SIZE_MAX for the root.
+    size_t parent;
+    size_t depth;
+    int64_t inclusive_ns;
+    int64_t self_ns;
+    uint64_t count;
+  };
+
+  /// @brief Return the process-wide profiler, which is never destroyed.
+  static auto Global() -> ZoneProfiler& {
+    static auto* profiler = new ZoneProfiler();
+    return *profiler;
+  }
+
+  /// @brief Enter a zone on the calling thread.
+  static void Enter(const char* label) { Tree().Enter(label); }
+
+  /// @brief Exit the innermost zone of the calling thread.
+  static void Exit() { tree_->Exit(); }
+
+  /**
+   * \brief Merge the call trees of all threads.
+   *
+   * Nodes are returned in depth-first order. Node 0 is the root, which has no label.
+   * Zones that are still active are not included.
+   */
+  auto Collect() -> std::vector<Node> {
+    std::vector<Node> result = {{nullptr, SIZE_MAX, 0, 0, 0, 0}};
+    std::map<std::pair<size_t, const char*>, size_t> index;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& tree : trees_) {
+      std::lock_guard<std::mutex> tree_lock(tree->mutex);
+      Merge(*tree, 0, 0, &result, &index);
+    }
+    // Convert to depth-first order, so that the output is stable and easy to render.
+    std::vector<std::vector<size_t>> children(result.size());
+    for (size_t i = 1; i < result.size(); i++) children[result[i].parent].push_back(i);
+    std::vector<Node> ordered;
+    std::vector<size_t> new_index(result.size());
+    std::vector<size_t> todo = {0};
+    while (!todo.empty()) {
+      auto i = todo.back();
+      todo.pop_back();
+      new_index[i] = ordered.size();
+      ordered.push_back(result[i]);
+      if (i != 0) ordered.back().parent = new_index[result[i].parent];
+      todo.insert(todo.end(), children[i].rbegin(), children[i].rend());
+    }
+    return ordered;
+  }
+
+  /**
+   * \brief Render the merged call tree as folded stacks.
+   *
+   * Every zone with non-zero self time results in one line of the form
+   * "outer;inner;innermost <self time in ns>", as consumed by flame graph tools.
+   */
+  auto FoldedStacks() -> std::string {
+    auto nodes = Collect();
+    std::vector<std::string> paths(nodes.size());
+    std::string result;
+    for (size_t i = 1; i < nodes.size(); i++) {
+      const auto& n = nodes[i];
+      paths[i] = (n.parent == 0 ? std::string() : paths[n.parent] + ";") + n.label;
+      if (n.self_ns > 0) result += paths[i] + " " + std::to_string(n.self_ns) + "\n";
+    }
+    return result;
+  }
+
+  /// @brief Reset the counters of all threads. Zones that are active remain active.
+  void Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& tree : trees_) {
+      std::lock_guard<std::mutex> tree_lock(tree->mutex);
+      for (auto& node : tree->nodes) {
+        node.inclusive_ns.store(0, std::memory_order_relaxed);
+        node.children_ns.store(0, std::memory_order_relaxed);
+        node.count.store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+
+ private:
+  ZoneProfiler() = default;
+
+  static auto Tree() -> internal::ZoneTree& {
+    if (tree_ == nullptr) {
+      auto& profiler = Global();
+      std::lock_guard<std::mutex> lock(profiler.mutex_);
+      // Trees are owned by the profiler, so they can be collected after threads exit.
+      tree_ = profiler.trees_.emplace_back(std::make_unique<internal::ZoneTree>()).get();
+    }
+    return *tree_;
+  }
+
+  static void Merge(const internal::ZoneTree& tree, uint32_t node, size_t merged,
+                    std::vector<Node>* result,
+                    std::map<std::pair<size_t, const char*>, size_t>* index) {
+    const auto& n = tree.nodes[node];
+    for (auto c = n.first_child.load(std::memory_order_acquire);
+         c != internal::ZoneNode::kNone;
+         c = tree.nodes[c].next_sibling.load(std::memory_order_relaxed)) {
+      const auto& child = tree.nodes[c];
+      auto [it, inserted] = index->try_emplace({merged, child.label}, result->size());
+      if (inserted) {
+        result->push_back({child.label, merged, (*result)[merged].depth + 1, 0, 0, 0});
+      }
+      auto inclusive = child.inclusive_ns.load(std::memory_order_relaxed);
+      auto& m = (*result)[it->second];
+      m.inclusive_ns += inclusive;
+      m.self_ns += inclusive - child.children_ns.load(std::memory_order_relaxed);
+      m.count += child.count.load(std::memory_order_relaxed);
+      Merge(tree, c, it->second, result, index);
+    }
+  }
+
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<internal::ZoneTree>> trees_;
+  static inline thread_local internal::ZoneTree* tree_ = nullptr;
+};
+
+/// @brief A zone that is entered on construction and exited on destruction.
+class Zone {
+ public:
+  explicit Zone(const char* label) { ZoneProfiler::Enter(label); }
+  ~Zone() { ZoneProfiler::Exit(); }
+  Zone(const Zone&) = delete;
+  auto operator=(const Zone&) -> Zone& = delete;
+};
+
+}  // namespace putong
+
+#define PUTONG_ZONE_CONCAT_(a, b) a##b
+#define PUTONG_ZONE_CONCAT(a, b) PUTONG_ZONE_CONCAT_(a, b)
+
+/// @brief Time the rest of the enclosing scope as a zone with the given label.
+#define PUTONG_ZONE(label) \
+  ::putong::Zone PUTONG_ZONE_CONCAT(putong_zone_, __LINE__)(label)
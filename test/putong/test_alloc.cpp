@@ -0,0 +1,73 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gmock/gmock.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <new>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// This is the only translation unit of the tests that installs the hooks.
+#include "putong/alloc_hooks.h"
+#include "putong/timer_report.h"
+
+namespace putong {
+
+TEST(Alloc, Stats) {
+  ASSERT_TRUE(AllocStats::installed());
+
+  // Call the operators directly, since new-expressions may be elided.
+  auto before = AllocStats::ForThisThread();
+  void* p = ::operator new(100);
+  void* q = ::operator new(100, std::align_val_t{256});
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(q) % 256, 0);
+  auto allocated = AllocStats::ForThisThread() - before;
+  ::operator delete(p);
+  ::operator delete(q, std::align_val_t{256});
+  ::operator delete(nullptr);
+  auto freed = AllocStats::ForThisThread() - before;
+
+  ASSERT_EQ(allocated.allocations, 2);
+  ASSERT_EQ(allocated.bytes, 200);
+  ASSERT_EQ(allocated.deallocations, 0);
+  ASSERT_EQ(freed.deallocations, 2);
+
+  // Allocations of other threads are not counted.
+  before = AllocStats::ForThisThread();
+  std::thread([] { ::operator delete(::operator new(1000)); }).join();
+  ASSERT_LT((AllocStats::ForThisThread() - before).bytes, 1000);
+}
+
+TEST(Alloc, Timer) {
+  AllocTimer<2> t(true);
+  t.Split();
+  std::vector<int> v;
+  for (int i = 0; i < 100; i++) v.push_back(i);
+  t.Split();
+
+  ASSERT_EQ(t.allocations(0), 0);
+  ASSERT_GE(t.allocations(1), 1);
+  ASSERT_GE(t.bytes(1), 100 * sizeof(int));
+  ASSERT_GE(t.nanoseconds(1), 0);
+
+  std::stringstream ss;
+  report(t, ss);
+  auto out = ss.str();
+  ASSERT_EQ(std::count(out.begin(), out.end(), ','), 5);
+}
+
+}  // namespace putong
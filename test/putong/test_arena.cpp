@@ -0,0 +1,80 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gmock/gmock.h>
+
+#include <cstdint>
+#include <cstring>
+
+#include "putong/arena.h"
+
+namespace putong {
+
+TEST(Arena, Allocate) {
+  Arena<64> arena;
+  void* a = nullptr;
+  void* b = nullptr;
+  ASSERT_TRUE(arena.Allocate(3, 1, &a).ok());
+  ASSERT_TRUE(arena.Allocate(8, 8, &b).ok());
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(b) % 8, 0);
+  ASSERT_GE(static_cast<char*>(b), static_cast<char*>(a) + 3);
+  ASSERT_EQ(arena.blocks(), 0);
+
+  // Exceeding the inline block allocates heap blocks of growing size.
+  uint64_t* values = nullptr;
+  ASSERT_TRUE(arena.Allocate(100, &values).ok());
+  std::memset(values, 0, 100 * sizeof(uint64_t));
+  ASSERT_EQ(arena.blocks(), 1);
+  void* aligned = nullptr;
+  ASSERT_TRUE(arena.Allocate(16, 256, &aligned).ok());
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(aligned) % 256, 0);
+  ASSERT_EQ(arena.used(), 3 + 8 + 800 + 16);
+
+  auto status = arena.Allocate(1, 3, &a);
+  ASSERT_FALSE(status.ok());
+  ASSERT_EQ(status.err(), ArenaError::Alignment);
+}
+
+TEST(Arena, ResetReusesBlocks) {
+  Arena<64> arena;
+  void* p = nullptr;
+  for (int i = 0; i < 10; i++) ASSERT_TRUE(arena.Allocate(100, 8, &p).ok());
+  auto reserved = arena.reserved();
+  auto blocks = arena.blocks();
+
+  arena.Reset();
+  ASSERT_EQ(arena.used(), 0);
+  for (int i = 0; i < 10; i++) ASSERT_TRUE(arena.Allocate(100, 8, &p).ok());
+  ASSERT_EQ(arena.reserved(), reserved);
+  ASSERT_EQ(arena.blocks(), blocks);
+
+  arena.Release();
+  ASSERT_EQ(arena.blocks(), 0);
+  ASSERT_EQ(arena.reserved(), 64);
+}
+
+TEST(Arena, Cap) {
+  Histogram latency;
+  Arena<64> arena(1024, &latency);
+  void* p = nullptr;
+  ASSERT_TRUE(arena.Allocate(512, 8, &p).ok());
+  ASSERT_TRUE(arena.Allocate(256, 8, &p).ok());
+  auto status = arena.Allocate(512, 8, &p);
+  ASSERT_FALSE(status.ok());
+  ASSERT_EQ(status.err(), ArenaError::Exhausted);
+  ASSERT_LE(arena.reserved(), 1024);
+  ASSERT_EQ(latency.count(), arena.blocks());
+}
+
+}  // namespace putong
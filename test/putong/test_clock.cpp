@@ -0,0 +1,103 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+#include "putong/clock.h"
+#include "putong/timer.h"
+
+namespace putong {
+
+namespace {
+
+template <typename clock>
+void ExpectSleep(double tolerance) {
+  using namespace std::chrono_literals;
+  Timer<clock> t(true);
+  std::this_thread::sleep_for(50ms);
+  t.Stop();
+  ASSERT_GT(t.seconds(), 0.05 - tolerance);
+  // Only the lower bound is tight. A 50 ms sleep can overrun by a lot under load, but
+  // not tenfold, so this catches a clock that counts in the wrong unit.
+  ASSERT_LT(t.seconds(), 0.5);
+}
+
+}  // namespace
+
+#if defined(__linux__)
+TEST(Clock, MonotonicRaw) { ExpectSleep<monotonic_raw_clock>(0.001); }
+
+TEST(Clock, MonotonicCoarse) { ExpectSleep<monotonic_coarse_clock>(0.01); }
+#endif
+
+#if defined(__linux__)
+TEST(Clock, ThreadCpu) {
+  using namespace std::chrono_literals;
+  Timer<thread_cpu_clock> sleeping(true);
+  std::this_thread::sleep_for(50ms);
+  sleeping.Stop();
+  ASSERT_LT(sleeping.seconds(), 0.01);
+
+  Timer<thread_cpu_clock> spinning(true);
+  auto until = std::chrono::steady_clock::now() + 20ms;
+  while (std::chrono::steady_clock::now() < until) {
+  }
+  spinning.Stop();
+  ASSERT_GT(spinning.nanoseconds(), 0);
+  // A preempted spin uses less CPU time than its 20 ms of wall time, never more, so
+  // anything close to 0.5 s is a conversion error of the CPU clock.
+  ASSERT_LT(spinning.seconds(), 0.5);
+
+  if (thread_cpu_clock::uses_perf()) {
+    // The perf_event task clock has the same epoch as the system call.
+    auto perf = thread_cpu_clock::now().time_since_epoch().count();
+    auto posix = internal::PosixNow<CLOCK_THREAD_CPUTIME_ID>();
+    ASSERT_LT(std::abs(posix - perf), 1000000);
+  }
+}
+#endif
+
+#if PUTONG_HAS_TSC
+TEST(Clock, Tsc) {
+  ExpectSleep<tsc_clock>(0.001);
+  ASSERT_GT(internal::Tsc().ticks_per_second, 0);
+}
+#endif
+
+TEST(Clock, Dispatch) {
+  static_assert(noexcept(dispatch_clock::now()));
+  // Selecting the source up front reports failures to probe, instead of falling back.
+  dispatch_clock::Init();
+  ExpectSleep<dispatch_clock>(0.01);
+
+  const auto& s = dispatch_clock::selection();
+  ASSERT_FALSE(s.probes.empty());
+  ASSERT_FALSE(s.reason.empty());
+  bool found = false;
+  for (const auto& p : s.probes) {
+    ASSERT_GT(p.overhead_ns, 0.0);
+    ASSERT_FALSE(p.reason.empty());
+    if (p.source == s.source) {
+      found = true;
+      ASSERT_STREQ(p.name, s.name);
+    }
+  }
+  ASSERT_TRUE(found);
+}
+
+}  // namespace putong
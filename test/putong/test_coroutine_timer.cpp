@@ -0,0 +1,117 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <coroutine>
+#include <thread>
+
+#include "putong/coroutine_timer.h"
+
+namespace putong {
+
+namespace {
+
+/// A coroutine that starts eagerly and is destroyed by its owner.
+struct Task {
+  struct promise_type {
+    auto get_return_object() -> Task {
+      return {std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    auto initial_suspend() -> std::suspend_never { return {}; }
+    auto final_suspend() noexcept -> std::suspend_always { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+/// An awaitable that suspends, and stores the handle to be resumed by the test.
+struct Event {
+  auto await_ready() const -> bool { return ready; }
+  void await_suspend(std::coroutine_handle<> h) { waiter = h; }
+  auto await_resume() const -> int { return 42; }
+
+  bool ready = false;
+  std::coroutine_handle<> waiter;
+};
+
+/// An awaitable with a member operator co_await.
+struct Indirect {
+  auto operator co_await() -> Event& { return *event; }
+  Event* event;
+};
+
+}  // namespace
+
+TEST(CoroutineTimer, ExcludesSuspendedTime) {
+  CoroutineTimer<> timer;
+  Event event;
+  Event ready{true, {}};
+  int result = 0;
+
+  auto coroutine = [&]() -> Task {
+    timer.Start();
+    result += co_await timer.Await(event);
+    result += co_await timer.Await(Indirect{&event});
+    result += co_await timer.Await(ready);
+    timer.Stop();
+  };
+
+  auto task = coroutine();
+  for (int i = 0; i < 2; i++) {
+    ASSERT_TRUE(event.waiter);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::exchange(event.waiter, nullptr).resume();
+  }
+  ASSERT_TRUE(task.handle.done());
+  task.handle.destroy();
+
+  ASSERT_EQ(result, 126);
+  ASSERT_EQ(timer.suspensions(), 2);
+  ASSERT_GE(timer.suspended_nanoseconds(), 40'000'000);
+  ASSERT_LT(timer.active_nanoseconds(), timer.nanoseconds() / 2);
+  ASSERT_GT(timer.seconds(), timer.active_seconds());
+}
+
+TEST(CoroutineTimer, ReadyAwaitKeepsRunning) {
+  CoroutineTimer<> timer;
+  Event ready{true, {}};
+
+  auto spin = [] {
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(5);
+    while (std::chrono::steady_clock::now() < end) {
+    }
+  };
+  auto coroutine = [&]() -> Task {
+    timer.Start();
+    spin();
+    co_await timer.Await(ready);
+    spin();
+    timer.Stop();
+  };
+
+  auto task = coroutine();
+  ASSERT_TRUE(task.handle.done());
+  task.handle.destroy();
+
+  // The coroutine never suspended, so all of the wall time is active.
+  ASSERT_EQ(timer.suspensions(), 0);
+  ASSERT_GE(timer.nanoseconds(), 10'000'000);
+  ASSERT_EQ(timer.active_nanoseconds(), timer.nanoseconds());
+}
+
+}  // namespace putong
@@ -0,0 +1,94 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "putong/histogram.h"
+
+namespace putong {
+
+TEST(Histogram, Buckets) {
+  for (uint64_t v : {0ul, 1ul, 63ul, 64ul, 65ul, 1000ul, 123456789ul, 1ul << 62}) {
+    auto i = Histogram::BucketIndex(v);
+    ASSERT_LE(Histogram::BucketLower(i), v);
+    ASSERT_GE(Histogram::BucketUpper(i), v);
+    ASSERT_LE(Histogram::BucketUpper(i) - Histogram::BucketLower(i), v / 32);
+  }
+  ASSERT_EQ(Histogram::BucketIndex(UINT64_MAX), Histogram::kBuckets - 1);
+}
+
+TEST(Histogram, Percentile) {
+  Histogram h;
+  for (int64_t v = 1; v <= 1000; v++) h.Record(v * 1000);
+
+  ASSERT_EQ(h.count(), 1000);
+  ASSERT_EQ(h.sum(), 500500000);
+  ASSERT_EQ(h.min(), 1000);
+  ASSERT_EQ(h.max(), 1000000);
+  ASSERT_EQ(h.Percentile(100), 1000000);
+  ASSERT_NEAR(h.Percentile(50), 500000, 500000 / 32);
+  ASSERT_NEAR(h.Percentile(99), 990000, 990000 / 32);
+
+  Histogram copy = h;
+  copy.Merge(h);
+  ASSERT_EQ(copy.count(), 2000);
+  ASSERT_EQ(copy.Percentile(50), h.Percentile(50));
+}
+
+TEST(Histogram, Concurrent) {
+  Histogram h;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&h] {
+      for (int i = 0; i < 10000; i++) h.Record(i);
+    });
+  }
+  for (auto& t : threads) t.join();
+  ASSERT_EQ(h.count(), 40000);
+  ASSERT_EQ(h.max(), 9999);
+}
+
+TEST(RollingHistogram, Window) {
+  using namespace std::chrono_literals;
+  using clock = std::chrono::steady_clock;
+  RollingHistogram<clock> r(1s, 3);
+  auto t0 = clock::time_point(1000s);
+
+  r.Record(10, t0);
+  r.Record(20, t0 + 1s);
+  r.Record(30, t0 + 2s);
+  ASSERT_EQ(r.Snapshot(t0 + 2s, 3).count(), 3);
+  ASSERT_EQ(r.Snapshot(t0 + 2s, 1).max(), 30);
+
+  // The first bucket drops out of the window.
+  r.Record(40, t0 + 3s);
+  auto s = r.Snapshot(t0 + 3s, 3);
+  ASSERT_EQ(s.count(), 3);
+  ASSERT_EQ(s.min(), 20);
+
+  // Readers don't rotate, but skip buckets that are older than the window.
+  ASSERT_EQ(r.Snapshot(t0 + 5s, 3).count(), 1);
+  ASSERT_EQ(r.Snapshot(t0 + 9s, 3).count(), 0);
+
+  // After an idle period, all stale buckets are cleared.
+  r.Record(50, t0 + 20s);
+  ASSERT_EQ(r.Snapshot(t0 + 20s, 3).count(), 1);
+  ASSERT_EQ(r.Snapshot(t0 + 20s, 3).max(), 50);
+}
+
+}  // namespace putong
@@ -0,0 +1,92 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "putong/meter.h"
+
+namespace putong {
+
+/// A clock that only advances when told to.
+struct manual_clock {
+  using rep = int64_t;
+  using period = std::nano;
+  using duration = std::chrono::nanoseconds;
+  using time_point = std::chrono::time_point<manual_clock>;
+  static constexpr bool is_steady = true;
+
+  static auto now() noexcept -> time_point { return time_point(current); }
+  static inline duration current{};
+};
+
+TEST(Meter, Rate) {
+  using namespace std::chrono_literals;
+  Meter<manual_clock> m;
+
+  // 10 events per second during the first tick initialize the averages.
+  m.Mark(50);
+  manual_clock::current += 5s;
+  ASSERT_DOUBLE_EQ(m.rate1(), 10.0);
+  ASSERT_DOUBLE_EQ(m.rate15(), 10.0);
+
+  // Without events, the one-minute average decays faster than the others.
+  manual_clock::current += 60s;
+  auto r1 = m.rate1();
+  ASSERT_NEAR(r1, 10.0 * std::exp(-1.0), 1e-9);
+  ASSERT_GT(m.rate5(), r1);
+  ASSERT_GT(m.rate15(), m.rate5());
+  ASSERT_EQ(m.count(), 50);
+}
+
+TEST(Meter, Striped) {
+  Meter<> m;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&m] {
+      for (int i = 0; i < 10000; i++) m.Mark();
+    });
+  }
+  for (auto& t : threads) t.join();
+  ASSERT_EQ(m.count(), 80000);
+}
+
+TEST(EwmaTimer, Mean) {
+  using namespace std::chrono_literals;
+  EwmaTimer<manual_clock> t;
+
+  t.Record(100);
+  t.Record(300);
+  manual_clock::current += 5s;
+  ASSERT_DOUBLE_EQ(t.mean1(), 200.0);
+
+  // Ticks without events leave the latency averages unchanged.
+  manual_clock::current += 30s;
+  ASSERT_DOUBLE_EQ(t.mean1(), 200.0);
+
+  Timer<manual_clock> timer(true);
+  manual_clock::current += 1000ns;
+  timer.Stop();
+  t.Record(timer);
+  manual_clock::current += 5s;
+  ASSERT_GT(t.mean1(), 200.0);
+  ASSERT_LT(t.mean1(), 1000.0);
+  ASSERT_EQ(t.count(), 3);
+  ASSERT_EQ(t.sum(), 1400);
+}
+
+}  // namespace putong
@@ -0,0 +1,124 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gmock/gmock.h>
+
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "putong/object_pool.h"
+
+namespace putong {
+
+TEST(ObjectPool, MakeDelete) {
+  ObjectPool<std::string> pool;
+  auto* a = pool.Make("a");
+  auto* b = pool.Make(3, 'b');
+  ASSERT_EQ(*a, "a");
+  ASSERT_EQ(*b, "bbb");
+  pool.Delete(a);
+
+  // Slots are reused without growing the pool.
+  auto capacity = pool.capacity();
+  std::vector<std::string*> objects;
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < 1000; i++) objects.push_back(pool.Make(std::to_string(i)));
+    if (round == 0) capacity = pool.capacity();
+    for (auto* o : objects) pool.Delete(o);
+    objects.clear();
+  }
+  ASSERT_EQ(pool.capacity(), capacity);
+  pool.Delete(b);
+}
+
+TEST(ObjectPool, ThrowingConstructor) {
+  struct Throwing {
+    explicit Throwing(bool fail) {
+      if (fail) throw std::runtime_error("fail");
+    }
+  };
+  ObjectPool<Throwing> pool;
+  auto* a = pool.Make(false);
+  pool.Delete(a);
+  ASSERT_THROW(pool.Make(true), std::runtime_error);
+  // The slot is back in the pool.
+  ASSERT_EQ(pool.Make(false), a);
+}
+
+TEST(ObjectPool, Concurrent) {
+  ObjectPool<uint64_t> pool;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&pool, t] {
+      std::vector<uint64_t*> live;
+      for (int i = 0; i < 20000; i++) {
+        live.push_back(pool.Make(t));
+        if (live.size() == 100) {
+          for (auto* p : live) {
+            ASSERT_EQ(*p, static_cast<uint64_t>(t));
+            pool.Delete(p);
+          }
+          live.clear();
+        }
+      }
+      for (auto* p : live) pool.Delete(p);
+    });
+  }
+  for (auto& t : threads) t.join();
+  // Objects that were live at the same time had distinct slots, so every thread needs at
+  // most about 100 slots at a time.
+  ASSERT_LT(pool.capacity(), 4 * 100 + 4 * 2 * ObjectPool<uint64_t>::kCacheSize + 64);
+}
+
+TEST(ObjectPool, ConcurrentGrowth) {
+  // Threads that reserve slots at the same time race to install the same chunks.
+  ObjectPool<uint64_t> pool;
+  std::vector<std::vector<uint64_t*>> made(4);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&pool, &made, t] {
+      for (int i = 0; i < 10000; i++) made[t].push_back(pool.Make(t));
+    });
+  }
+  for (auto& t : threads) t.join();
+  std::set<uint64_t*> distinct;
+  for (int t = 0; t < 4; t++) {
+    for (auto* p : made[t]) {
+      ASSERT_EQ(*p, static_cast<uint64_t>(t));
+      distinct.insert(p);
+    }
+  }
+  ASSERT_EQ(distinct.size(), 40000);
+  ASSERT_GE(pool.capacity(), 40000);
+  for (auto& v : made) {
+    for (auto* p : v) pool.Delete(p);
+  }
+}
+
+TEST(ObjectPool, OtherPoolOfSameType) {
+  ObjectPool<int> a;
+  ObjectPool<int> b;
+  auto* x = a.Make(1);
+  auto* y = b.Make(2);
+  a.Delete(x);
+  b.Delete(y);
+  auto* z = a.Make(3);
+  ASSERT_EQ(*z, 3);
+  a.Delete(z);
+}
+
+}  // namespace putong
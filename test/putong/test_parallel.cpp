@@ -0,0 +1,92 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "putong/parallel.h"
+
+namespace putong {
+
+TEST(Parallel, For) {
+  std::vector<std::atomic<int>> hits(10000);
+  std::atomic<size_t> max_chunk = 0;
+  SplitTimer<3> timer;
+  parallel_for(
+      {0, hits.size()}, 64,
+      [&](Range r) {
+        for (auto i = r.begin; i < r.end; i++) hits[i]++;
+        if (r.size() > max_chunk) max_chunk = r.size();
+      },
+      {}, &timer);
+  for (auto& h : hits) ASSERT_EQ(h.load(), 1);
+  ASSERT_LE(max_chunk.load(), 64);
+  ASSERT_EQ(timer.split_idx.load(), 4);
+  ASSERT_GE(timer.total_nanoseconds(), 0);
+
+  // Empty ranges do not run anything, but still complete the hook.
+  parallel_for({5, 5}, 1, [&](Range) { FAIL(); }, {}, &timer);
+  ASSERT_EQ(timer.split_idx.load(), 4);
+}
+
+TEST(Parallel, Reduce) {
+  ThreadPool pool(3);
+  for (bool affinity : {false, true}) {
+    auto sum = parallel_reduce(
+        {1, 100001}, 100, uint64_t{0},
+        [](Range r) {
+          uint64_t s = 0;
+          for (auto i = r.begin; i < r.end; i++) s += i;
+          return s;
+        },
+        [](uint64_t a, uint64_t b) { return a + b; }, {&pool, affinity});
+    ASSERT_EQ(sum, uint64_t{100000} * 100001 / 2);
+  }
+}
+
+TEST(Parallel, Affinity) {
+  // With a grain of a whole part, parts are not split, so no worker is busy with a part
+  // of another worker when its own part arrives. An idle worker runs the tasks in its
+  // inbox itself, so part i runs on worker i.
+  ThreadPool pool(3);
+  std::vector<std::atomic<int>> owner(3000);
+  for (auto& o : owner) o = -1;
+  parallel_for(
+      {0, owner.size()}, 1000,
+      [&](Range r) {
+        for (auto i = r.begin; i < r.end; i++) owner[i] = pool.worker_index();
+      },
+      {&pool, true});
+  for (size_t i = 0; i < owner.size(); i++) {
+    ASSERT_EQ(owner[i].load(), static_cast<int>(i / 1000));
+  }
+}
+
+TEST(Parallel, Nested) {
+  ThreadPool pool(2);
+  std::atomic<int> count = 0;
+  parallel_for(
+      {0, 8}, 1,
+      [&](Range) {
+        parallel_for({0, 100}, 10, [&](Range r) { count += static_cast<int>(r.size()); },
+                     {&pool});
+      },
+      {&pool});
+  ASSERT_EQ(count.load(), 800);
+}
+
+}  // namespace putong
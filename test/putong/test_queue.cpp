@@ -0,0 +1,94 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gmock/gmock.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "putong/queue.h"
+
+namespace putong {
+
+TEST(SpscQueue, PushPop) {
+  SpscQueue<std::string> q(3);
+  ASSERT_EQ(q.capacity(), 4);
+  for (int i = 0; i < 4; i++) ASSERT_TRUE(q.TryPush(std::to_string(i)));
+  ASSERT_FALSE(q.TryPush("full"));
+
+  std::string s;
+  ASSERT_TRUE(q.TryPop(&s));
+  ASSERT_EQ(s, "0");
+  std::string batch[4];
+  ASSERT_EQ(q.TryPopBatch(batch, 4), 3);
+  ASSERT_EQ(batch[2], "3");
+  ASSERT_FALSE(q.TryPop(&s));
+
+  const std::string items[] = {"a", "b", "c", "d", "e"};
+  ASSERT_EQ(q.TryPushBatch(items, 5), 4);
+}
+
+TEST(SpscQueue, Blocking) {
+  SpscQueue<int, true> q(16);
+  std::thread producer([&q] {
+    for (int i = 0; i < 100000; i++) ASSERT_TRUE(q.Push(i));
+    q.Close();
+  });
+  int expected = 0;
+  int value = 0;
+  while (q.Pop(&value)) ASSERT_EQ(value, expected++);
+  producer.join();
+  ASSERT_EQ(expected, 100000);
+}
+
+TEST(MpscQueue, PushPop) {
+  MpscQueue<std::unique_ptr<int>> q(4);
+  for (int i = 0; i < 4; i++) ASSERT_TRUE(q.TryPush(std::make_unique<int>(i)));
+  ASSERT_FALSE(q.TryPush(std::make_unique<int>(4)));
+
+  std::unique_ptr<int> out[4];
+  ASSERT_EQ(q.TryPopBatch(out, 2), 2);
+  ASSERT_EQ(*out[1], 1);
+  // Elements that remain are destroyed with the queue.
+  ASSERT_TRUE(q.TryPush(std::make_unique<int>(5)));
+}
+
+TEST(MpscQueue, Producers) {
+  MpscQueue<int, true> q(64);
+  std::vector<std::thread> producers;
+  for (int p = 0; p < 4; p++) {
+    producers.emplace_back([&q, p] {
+      for (int i = 0; i < 10000; i++) {
+        if (i % 2 == 0) {
+          ASSERT_TRUE(q.Push(p));
+        } else {
+          const int batch[] = {p, p};
+          while (!q.TryPushBatch(batch, 2)) std::this_thread::yield();
+        }
+      }
+    });
+  }
+  std::vector<int> counts(4);
+  int value = 0;
+  for (int i = 0; i < 4 * 15000; i++) {
+    ASSERT_TRUE(q.Pop(&value));
+    counts[value]++;
+  }
+  for (auto& p : producers) p.join();
+  ASSERT_THAT(counts, ::testing::Each(15000));
+}
+
+}  // namespace putong
@@ -0,0 +1,90 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gmock/gmock.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "putong/registry.h"
+
+namespace putong {
+
+using ::testing::HasSubstr;
+
+TEST(Registry, Get) {
+  Registry r;
+  auto* h = r.Get<Histogram>("latency_seconds", "Request latency.");
+  ASSERT_NE(h, nullptr);
+  ASSERT_EQ(r.Get<Histogram>("latency_seconds"), h);
+  ASSERT_EQ(r.Get<Meter<>>("latency_seconds"), nullptr);
+  ASSERT_EQ(r.Get<Meter<>>("0invalid"), nullptr);
+  ASSERT_EQ(r.Get<Meter<>>("with space"), nullptr);
+  ASSERT_EQ(r.size(), 1);
+}
+
+TEST(Registry, Render) {
+  Registry r;
+  auto* h = r.Get<Histogram>("latency_seconds", "Request \"latency\".\n");
+  for (int i = 1; i <= 100; i++) h->Record(i * 1000000);
+  r.Get<Meter<>>("requests", "Requests.")->Mark(3);
+  r.Get<EwmaTimer<>>("parse_seconds")->Record(2000);
+
+  std::string out;
+  r.Render(&out);
+  ASSERT_THAT(out, HasSubstr("# TYPE latency_seconds summary\n"
+                             "# HELP latency_seconds Request \\\"latency\\\".\\n\n"
+                             "latency_seconds{quantile=\"0.5\"} 0.05"));
+  ASSERT_THAT(out, HasSubstr("latency_seconds_sum 5.05\nlatency_seconds_count 100\n"));
+  ASSERT_THAT(out, HasSubstr("# TYPE requests counter\n# HELP requests Requests.\n"
+                             "requests_total 3\n# TYPE requests_rate gauge\n"));
+  ASSERT_THAT(out, HasSubstr("parse_seconds_sum 2e-06\nparse_seconds_count 1\n"));
+  ASSERT_THAT(out, ::testing::EndsWith("# EOF\n"));
+
+  // Rendering again reuses the buffer.
+  auto capacity = out.capacity();
+  r.Render(&out);
+  ASSERT_EQ(out.capacity(), capacity);
+}
+
+TEST(Registry, EmptySummary) {
+  Registry r;
+  r.Get<Histogram>("empty_seconds");
+  r.Get<RollingHistogram<>>("rolling_seconds");
+
+  std::string out;
+  r.Render(&out);
+  ASSERT_THAT(out, HasSubstr("empty_seconds{quantile=\"0.5\"} NaN\n"
+                             "empty_seconds{quantile=\"0.9\"} NaN\n"));
+  ASSERT_THAT(out, HasSubstr("empty_seconds_sum 0\nempty_seconds_count 0\n"));
+  ASSERT_THAT(out, HasSubstr("rolling_seconds{quantile=\"0.999\"} NaN\n"));
+  ASSERT_THAT(out, HasSubstr("rolling_seconds_count 0\n"));
+}
+
+TEST(Registry, WriteFile) {
+  Registry r;
+  r.Get<Meter<>>("events")->Mark();
+  auto path = ::testing::TempDir() + "putong_registry.txt";
+  ASSERT_TRUE(r.WriteFile(path).ok());
+  std::stringstream ss;
+  ss << std::ifstream(path).rdbuf();
+  ASSERT_THAT(ss.str(), HasSubstr("events_total 1\n"));
+
+  auto status = r.WriteFile("/nonexistent/putong/metrics.txt");
+  ASSERT_FALSE(status.ok());
+  ASSERT_EQ(status.err(), RegistryError::File);
+}
+
+}  // namespace putong
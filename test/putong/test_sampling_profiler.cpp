@@ -0,0 +1,145 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+
+#include "putong/sampling_profiler.h"
+
+namespace putong {
+
+#if defined(__linux__)
+
+namespace {
+
+/// Return the ids of the POSIX timers of the process, which each have an "ID:" line in
+/// /proc/self/timers, or nullopt if that file is unavailable.
+auto Timers() -> std::optional<std::set<long>> {
+  std::ifstream file("/proc/self/timers");
+  if (!file) return std::nullopt;
+  std::set<long> ids;
+  for (std::string line; std::getline(file, line);) {
+    if (line.rfind("ID:", 0) == 0) ids.insert(std::stol(line.substr(3)));
+  }
+  return ids;
+}
+
+auto Spin(std::chrono::milliseconds duration) -> uint64_t {
+  volatile uint64_t x = 0;
+  Timer<> t(true);
+  do {
+    for (int i = 0; i < 1000; i++) x = x + i;
+    t.Stop();
+  } while (t.seconds() < std::chrono::duration<double>(duration).count());
+  return x;
+}
+
+}  // namespace
+
+TEST(SamplingProfiler, Stages) {
+  using namespace std::chrono_literals;
+  auto& profiler = SamplingProfiler::Global();
+  profiler.Clear();
+  ASSERT_TRUE(profiler.RegisterThread().ok());
+  ASSERT_TRUE(profiler.Start(1000).ok());
+  ASSERT_EQ(profiler.Start(1000).err(), SamplingError::AlreadyRunning);
+
+  SplitTimer<2> t;
+  {
+    auto tracking = SamplingProfiler::Track(t);
+    t.Start();
+    Spin(100ms);
+    t.Split();
+    Spin(100ms);
+    t.Split();
+  }
+
+  profiler.Stop();
+  profiler.UnregisterThread();
+
+  auto samples = profiler.Samples();
+  ASSERT_GT(samples.size(), 20);
+  size_t stages[3] = {};
+  for (const auto& s : samples) {
+    ASSERT_LE(s.stage, 2);
+    stages[s.stage]++;
+  }
+  ASSERT_GT(stages[1], 0);
+  ASSERT_GT(stages[2], 0);
+
+  auto folded = profiler.FoldedStacks();
+  ASSERT_THAT(folded, testing::HasSubstr("stage 0;"));
+  ASSERT_THAT(folded, testing::HasSubstr("stage 1;"));
+
+  const char* path = "putong_test_profile.prof";
+  ASSERT_TRUE(profiler.WritePprof(path).ok());
+  std::remove(path);
+  ASSERT_EQ(profiler.WritePprof("/nonexistent/profile.prof").err(), SamplingError::File);
+}
+
+TEST(SamplingProfiler, ThreadExit) {
+  auto before = Timers();
+  if (!before) GTEST_SKIP() << "/proc/self/timers is unavailable";
+
+  size_t registered = 0;
+  std::thread([&] {
+    ASSERT_TRUE(SamplingProfiler::Global().RegisterThread().ok());
+    registered = Timers()->size();
+  }).join();
+  ASSERT_EQ(registered, before->size() + 1);
+  ASSERT_EQ(Timers()->size(), before->size());
+}
+
+TEST(SamplingProfiler, FailedStart) {
+  auto before = Timers();
+  if (!before) GTEST_SKIP() << "/proc/self/timers is unavailable";
+  auto& profiler = SamplingProfiler::Global();
+  ASSERT_TRUE(profiler.RegisterThread().ok());
+
+  // Delete the timer of this thread behind the back of the profiler, so that arming it
+  // fails. glibc returns the kernel id of SIGEV_THREAD_ID timers as the timer_t.
+  long id = -1;
+  auto after = Timers();
+  for (long i : *after) {
+    if (before->count(i) == 0) id = i;
+  }
+  ASSERT_GE(id, 0);
+  ASSERT_EQ(timer_delete(reinterpret_cast<timer_t>(static_cast<intptr_t>(id))), 0);
+
+  struct sigaction previous {};
+  ASSERT_EQ(sigaction(SIGPROF, nullptr, &previous), 0);
+  ASSERT_EQ(profiler.Start(1000).err(), SamplingError::Timer);
+  struct sigaction current {};
+  ASSERT_EQ(sigaction(SIGPROF, nullptr, &current), 0);
+  ASSERT_EQ(current.sa_handler, previous.sa_handler);
+
+  // The failed start is undone, so the profiler does not report that it is running.
+  ASSERT_EQ(profiler.Start(1000).err(), SamplingError::Timer);
+  profiler.UnregisterThread();
+  ASSERT_TRUE(profiler.Start(1000).ok());
+  profiler.Stop();
+}
+
+#endif
+
+}  // namespace putong
@@ -0,0 +1,290 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gmock/gmock.h>
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "putong/backtrace.h"
+#include "putong/status.h"
+#include "putong/status_batch.h"
+#include "putong/status_io.h"
+
+namespace putong {
+
+enum class TestError { A, B };
+
+TEST(Status, OK) {
+  auto s = Status<TestError>::OK();
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(s.msg(), "");
+}
+
+TEST(Status, Error) {
+  Status<TestError> s(TestError::B, "something went wrong");
+  ASSERT_FALSE(s.ok());
+  ASSERT_EQ(s.err(), TestError::B);
+  ASSERT_EQ(s.msg(), "something went wrong");
+}
+
+TEST(Status, Stream) {
+  std::stringstream ss;
+  ss << Status<TestError>::OK() << ", " << Status<TestError>(TestError::B, "bad");
+  ASSERT_EQ(ss.str(), "OK, Error 1: bad");
+}
+
+TEST(Status, InternedMessage) {
+  Status<TestError> a(TestError::A, "timeout");
+  Status<TestError> b(TestError::A, InternPool::Global().Intern(std::string("timeout")));
+  auto c = a;
+
+  ASSERT_EQ(a.msg_handle(), b.msg_handle());
+  ASSERT_EQ(a.msg_handle(), c.msg_handle());
+  ASSERT_EQ(a.msg_handle().c_str(), b.msg_handle().c_str());
+  ASSERT_EQ(a.message(), "timeout");
+}
+
+TEST(Status, DynamicMessage) {
+  auto interned = InternPool::Global().size();
+  for (int i = 0; i < 1000; i++) {
+    Status<TestError> s(TestError::A, "no such file: " + std::to_string(i));
+    auto copy = s;
+    ASSERT_TRUE(copy.msg_handle().empty());
+    ASSERT_EQ(copy.message().data(), s.message().data());
+    ASSERT_EQ(copy.msg(), "no such file: " + std::to_string(i));
+  }
+  ASSERT_EQ(InternPool::Global().size(), interned);
+}
+
+TEST(Status, BufferMessage) {
+  auto interned = InternPool::Global().size();
+  for (int i = 0; i < 1000; i++) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "bad row %d", i);
+    Status<TestError> s(TestError::A, buf);
+    ASSERT_TRUE(s.msg_handle().empty());
+    ASSERT_EQ(s.message(), "bad row " + std::to_string(i));
+  }
+  // A buffer without a null character is copied in full.
+  char full[3] = {'a', 'b', 'c'};
+  ASSERT_EQ(Status<TestError>(TestError::A, full).message(), "abc");
+
+  StatusBatch<TestError> batch(1);
+  char buf[16];
+  std::snprintf(buf, sizeof(buf), "element %d", 0);
+  batch.Fail(0, TestError::B, buf);
+  ASSERT_EQ(batch.errors()[0].status.message(), "element 0");
+  ASSERT_EQ(InternPool::Global().size(), interned);
+}
+
+TEST(Status, WithContext) {
+  auto s = Status<TestError>(TestError::A, "unexpected end of input")
+               .WithContext("while parsing row 3")
+               .WithContext("while reading file x.csv");
+  ASSERT_EQ(s.msg(),
+            "while reading file x.csv: while parsing row 3: unexpected end of input");
+  ASSERT_EQ(s.msg_handle().view(), "unexpected end of input");
+
+  auto copy = s;
+  copy.WithContext("copy");
+  ASSERT_EQ(copy.msg(), "copy: " + s.msg());
+
+  auto ok = Status<TestError>::OK().WithContext("ignored");
+  ASSERT_TRUE(ok.ok());
+  ASSERT_EQ(ok.msg(), "");
+}
+
+TEST(Status, WithContextGrow) {
+  Status<TestError> s(TestError::B, "base");
+  std::string expected = "base";
+  for (int i = 0; i < 100; i++) {
+    auto frame = "frame " + std::to_string(i);
+    s.WithContext(frame);
+    expected = frame + ": " + expected;
+  }
+  ASSERT_EQ(s.msg(), expected);
+}
+
+TEST(Status, ErrorCode) {
+  auto s = Status<TestError>::FromErrno(TestError::B, ENOENT, "open");
+  ASSERT_FALSE(s.ok());
+  ASSERT_EQ(s.err(), TestError::B);
+  ASSERT_EQ(s.error_code(), std::errc::no_such_file_or_directory);
+  ASSERT_EQ(s.msg(), "open: " + std::generic_category().message(ENOENT));
+
+  auto t = Status<TestError>::FromErrorCode(s.error_code(), TestError::A);
+  ASSERT_EQ(t.err(), TestError::A);
+  ASSERT_EQ(t.error_code(), s.error_code());
+  ASSERT_EQ(t.msg(), std::generic_category().message(ENOENT));
+
+  ASSERT_TRUE(Status<TestError>::FromErrorCode(std::error_code(), TestError::A).ok());
+  ASSERT_FALSE(Status<TestError>::OK().error_code());
+}
+
+TEST(Status, ErrorCodeRoundTrip) {
+  for (auto code : {TestError::A, TestError::B}) {
+    Status<TestError> s(code, "bad");
+    auto ec = s.error_code();
+    ASSERT_TRUE(ec);
+    ASSERT_EQ(ec.category(), status_category<TestError>());
+
+    auto t = Status<TestError>::FromErrorCode(ec, TestError::B);
+    ASSERT_FALSE(t.ok());
+    ASSERT_EQ(t.err(), code);
+    ASSERT_FALSE(t.error_code() != ec);
+  }
+}
+
+TEST(Backtrace, Capture) {
+  Backtrace<4> trace;
+  trace.Capture();
+  ASSERT_GT(trace.size(), 0);
+  ASSERT_LE(trace.size(), 4);
+  ASSERT_NE(trace[0], nullptr);
+  ASSERT_THAT(trace.str(), testing::StartsWith("  #0 0x"));
+
+  Backtrace<1> origin;
+  origin.Capture();
+  ASSERT_EQ(origin.size(), 1);
+}
+
+TEST(Backtrace, Origin) {
+  Backtrace<1> one;
+  one.Capture();
+  Backtrace<4> four;
+  four.Capture();
+
+  // Frame 0 is the caller of Capture(), not putong itself.
+  auto name = SymbolName(one[0]);
+  if (name.empty()) GTEST_SKIP() << "the test executable does not export its symbols";
+  ASSERT_THAT(name, testing::HasSubstr("Backtrace_Origin_Test::TestBody"));
+  ASSERT_THAT(SymbolName(four[0]), testing::HasSubstr("Backtrace_Origin_Test::TestBody"));
+}
+
+TEST(InternPool, Deduplicate) {
+  InternPool pool(4);
+  auto a = pool.Intern("a");
+  auto b = pool.Intern("b");
+  auto a2 = pool.Intern(std::string("a"));
+
+  ASSERT_EQ(a, a2);
+  ASSERT_NE(a, b);
+  ASSERT_EQ(pool.size(), 2);
+  ASSERT_EQ(pool.bytes(), 2);
+  ASSERT_TRUE(pool.Intern("").empty());
+}
+
+TEST(InternPool, Concurrent) {
+  InternPool pool(8);
+  constexpr int kThreads = 8;
+  constexpr int kStrings = 256;
+  std::vector<std::vector<InternedString>> handles(kThreads);
+  std::vector<std::thread> threads;
+
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < kStrings; i++) {
+        handles[t].push_back(pool.Intern("message " + std::to_string(i)));
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+
+  ASSERT_EQ(pool.size(), kStrings);
+  for (int t = 1; t < kThreads; t++) {
+    ASSERT_EQ(handles[t], handles[0]);
+  }
+  ASSERT_EQ(handles[0][42].view(), "message 42");
+}
+
+TEST(StatusBatch, AllOK) {
+  StatusBatch<TestError> b(1000);
+  ASSERT_TRUE(b.all_ok());
+  ASSERT_EQ(b.count_errors(), 0);
+  ASSERT_TRUE(b.ToStatus().ok());
+}
+
+TEST(StatusBatch, Errors) {
+  StatusBatch<TestError> b(200);
+  b.Set(3, Status<TestError>::OK());
+  b.Set(150, Status<TestError>(TestError::B, "bad value"));
+  b.Fail(70, TestError::A, "out of range");
+  b.Fail(70, TestError::B, "ignored");
+  b.FailMask(0, 0b1011, TestError::A, InternPool::Global().Intern("masked"));
+
+  ASSERT_FALSE(b.all_ok());
+  ASSERT_EQ(b.count_errors(), 5);
+  ASSERT_TRUE(b.ok(2));
+  ASSERT_FALSE(b.ok(3));
+  ASSERT_FALSE(b.ok(70));
+  ASSERT_EQ(b.count_errors(0, 4), 3);
+  ASSERT_EQ(b.count_errors(4, 200), 2);
+  ASSERT_EQ(b.count_errors(64, 128), 1);
+  ASSERT_TRUE(b.all_ok(4, 70));
+  ASSERT_FALSE(b.all_ok(4, 71));
+
+  auto s = b.ToStatus();
+  ASSERT_EQ(s.err(), TestError::A);
+  ASSERT_EQ(s.msg(), "5 of 200 elements failed, first at index 0: masked");
+  ASSERT_EQ(s.msg_handle().view(), "masked");
+
+  b.Reset();
+  ASSERT_TRUE(b.all_ok());
+  ASSERT_EQ(b.count_errors(0, 200), 0);
+}
+
+TEST(StatusBatch, Bounds) {
+  StatusBatch<TestError> b(64);
+  b.Fail(64, TestError::A, "beyond the end");
+  b.Set(1000, Status<TestError>(TestError::B, "far beyond the end"));
+  ASSERT_TRUE(b.all_ok());
+  ASSERT_TRUE(b.ok(64));
+  ASSERT_EQ(b.bitmap().size(), 1);
+
+  b.Fail(63, TestError::A, "last");
+  ASSERT_FALSE(b.ok(63));
+  ASSERT_EQ(b.count_errors(0, 64), 1);
+  ASSERT_EQ(b.count_errors(60, 1000), 1);
+  ASSERT_FALSE(b.all_ok(63, 65));
+  ASSERT_TRUE(b.all_ok(64, 1000));
+
+  StatusBatch<TestError> empty;
+  empty.Fail(0, TestError::A, "none");
+  ASSERT_TRUE(empty.all_ok());
+  ASSERT_EQ(empty.count_errors(0, 64), 0);
+}
+
+TEST(StatusBatch, KeepsStatus) {
+  StatusBatch<TestError> b(70);
+  b.Set(5, Status<TestError>::FromErrno(TestError::B, ENOENT).WithContext("row 5"));
+  b.FailMask(1, ~uint64_t{0}, TestError::A, InternedString());
+  b.FailMask(2, ~uint64_t{0}, TestError::A, InternedString());
+
+  // Only elements 64 to 69 exist in the last word.
+  ASSERT_EQ(b.count_errors(), 7);
+  ASSERT_EQ(b.count_errors(64, 70), 6);
+  ASSERT_EQ(b.errors()[0].status.error_code(), std::errc::no_such_file_or_directory);
+
+  auto s = b.ToStatus();
+  ASSERT_EQ(s.err(), TestError::B);
+  ASSERT_EQ(s.error_code(), std::errc::no_such_file_or_directory);
+  ASSERT_EQ(s.msg(), "7 of 70 elements failed, first at index 5: row 5: " +
+                         std::generic_category().message(ENOENT));
+}
+
+}  // namespace putong
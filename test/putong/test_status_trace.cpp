@@ -0,0 +1,40 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gmock/gmock.h>
+
+#include <cerrno>
+#include <string>
+
+#include "putong/status.h"
+
+namespace putong {
+
+enum class TraceError { A };
+
+TEST(StatusTrace, Origin) {
+  Status<TraceError> literal(TraceError::A, "literal");
+  Status<TraceError> dynamic(TraceError::A, std::string("dynamic"));
+  auto errnum = Status<TraceError>::FromErrno(TraceError::A, ENOENT);
+
+  for (const auto* s : {&literal, &dynamic, &errnum}) {
+    ASSERT_GT(s->trace().size(), 0);
+    auto name = SymbolName(s->trace()[0]);
+    if (name.empty()) GTEST_SKIP() << "the test executable does not export its symbols";
+    ASSERT_THAT(name, testing::HasSubstr("StatusTrace_Origin_Test::TestBody"));
+  }
+  ASSERT_THAT(literal.msg(), testing::HasSubstr("StatusTrace_Origin_Test::TestBody"));
+}
+
+}  // namespace putong
@@ -0,0 +1,144 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "putong/thread_pool.h"
+
+namespace putong {
+
+TEST(WorkStealingDeque, PushPopSteal) {
+  int items[600];
+  internal::WorkStealingDeque<int> deque(2);
+  ASSERT_EQ(deque.Pop(), nullptr);
+  ASSERT_EQ(deque.Steal(), nullptr);
+  // Grows beyond the initial capacity.
+  for (auto& i : items) deque.Push(&i);
+  ASSERT_EQ(deque.Steal(), &items[0]);
+  ASSERT_EQ(deque.Pop(), &items[599]);
+  for (int i = 598; i > 0; i--) ASSERT_EQ(deque.Pop(), &items[i]);
+  ASSERT_EQ(deque.Pop(), nullptr);
+}
+
+TEST(ThreadPool, Submit) {
+  std::atomic<int> count = 0;
+  ThreadPool pool(4);
+  ASSERT_EQ(pool.size(), 4);
+  ASSERT_EQ(pool.worker_index(), -1);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 3; t++) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < 1000; i++) {
+        ASSERT_TRUE(pool.Submit([&] { count.fetch_add(1); }).ok());
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+  pool.Shutdown();
+  ASSERT_EQ(count.load(), 3000);
+  ASSERT_EQ(pool.queue_wait().count(), 3000);
+  ASSERT_EQ(pool.run_time().count(), 3000);
+}
+
+TEST(ThreadPool, Nested) {
+  std::atomic<int> count = 0;
+  std::atomic<bool> in_worker = true;
+  ThreadPool pool(3);
+  // Every task submits two children up to a depth of 10, from inside the pool.
+  std::function<void(int)> spawn = [&](int depth) {
+    count.fetch_add(1);
+    if (pool.worker_index() < 0) in_worker = false;
+    if (depth == 0) return;
+    for (int i = 0; i < 2; i++) {
+      if (!pool.Submit([&spawn, depth] { spawn(depth - 1); }).ok()) in_worker = false;
+    }
+  };
+  ASSERT_TRUE(pool.Submit([&] { spawn(10); }).ok());
+  pool.Shutdown();
+  ASSERT_EQ(count.load(), 2047);
+  ASSERT_TRUE(in_worker.load());
+}
+
+TEST(ThreadPool, BusyWorkerInbox) {
+  using namespace std::chrono_literals;
+  ThreadPool pool(2);
+  std::atomic<bool> blocking = false;
+  std::atomic<bool> release = false;
+  ASSERT_TRUE(pool.SubmitTo(0, [&] {
+                    blocking = true;
+                    while (!release.load()) std::this_thread::yield();
+                  }).ok());
+  while (!blocking.load()) std::this_thread::yield();
+
+  // Worker 0 is busy until released, so the other worker takes the task from its inbox.
+  std::atomic<int> ran_on = -1;
+  ASSERT_TRUE(pool.SubmitTo(0, [&] { ran_on = pool.worker_index(); }).ok());
+  auto deadline = std::chrono::steady_clock::now() + 10s;
+  while (ran_on.load() < 0 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::yield();
+  }
+  release = true;
+  ASSERT_EQ(ran_on.load(), 1);
+}
+
+TEST(ThreadPool, FullInboxes) {
+  std::atomic<int> count = 0;
+  std::atomic<bool> release = false;
+  ThreadPool pool(1);
+  ASSERT_TRUE(pool.Submit([&] {
+                    while (!release.load()) std::this_thread::yield();
+                  }).ok());
+  // The only worker is busy, so its inbox fills up.
+  Status<ThreadPoolError> status;
+  int submitted = 0;
+  for (; submitted < 4 * static_cast<int>(ThreadPool::kInboxCapacity); submitted++) {
+    status = pool.Submit([&] { count.fetch_add(1); });
+    if (!status.ok()) break;
+  }
+  release = true;
+  ASSERT_FALSE(status.ok());
+  ASSERT_EQ(status.err(), ThreadPoolError::Full);
+
+  // A task that fills the inbox of its own worker keeps the rest on its deque.
+  // Zero while submitting, then one if all submissions succeeded, or two if not.
+  std::atomic<int> outcome = 0;
+  ASSERT_TRUE(pool.Submit([&] {
+                    bool ok = true;
+                    for (size_t i = 0; i < 2 * ThreadPool::kInboxCapacity; i++) {
+                      ok = ok && pool.SubmitTo(0, [&] { count.fetch_add(1); }).ok();
+                    }
+                    outcome = ok ? 1 : 2;
+                  }).ok());
+  while (outcome.load() == 0) std::this_thread::yield();
+  pool.Shutdown();
+  ASSERT_EQ(outcome.load(), 1);
+  ASSERT_EQ(count.load(), submitted + 2 * static_cast<int>(ThreadPool::kInboxCapacity));
+}
+
+TEST(ThreadPool, Shutdown) {
+  ThreadPool pool(1);
+  pool.Shutdown();
+  pool.Shutdown();
+  auto status = pool.Submit([] {});
+  ASSERT_FALSE(status.ok());
+  ASSERT_EQ(status.err(), ThreadPoolError::Shutdown);
+}
+
+}  // namespace putong
@@ -14,10 +14,15 @@
 
 #include <gmock/gmock.h>
 
+#include <algorithm>
 #include <chrono>
+#include <sstream>
 #include <thread>
 
+#include "putong/dual_timer.h"
+#include "putong/sched_timer.h"
 #include "putong/timer.h"
+#include "putong/timer_report.h"
 
 namespace putong {
 
@@ -37,7 +42,103 @@ TEST(Timer, Split) {
     ASSERT_TRUE(split > 0.04 && split < 0.06);
   }
 
-  t.report(std::cout);
+  report(t, std::cout);
+}
+
+TEST(Timer, Report) {
+  Timer<> t;
+  t.start_ = Timer<>::point(std::chrono::milliseconds(1000));
+  t.stop_ = Timer<>::point(std::chrono::milliseconds(1250));
+
+  ASSERT_EQ(str(t), "   0.250000000");
+  std::stringstream ss;
+  report(t, ss, true);
+  ASSERT_EQ(ss.str(), "    0.250000000\n");
+}
+
+#if defined(__linux__)
+TEST(Timer, Dual) {
+  using namespace std::chrono_literals;
+  DualTimer<2> t(true);
+  auto until = std::chrono::steady_clock::now() + 20ms;
+  while (std::chrono::steady_clock::now() < until) {
+  }
+  t.Split();
+  std::this_thread::sleep_for(20ms);
+  t.Split();
+
+  ASSERT_GE(t.wall_nanoseconds(0), 20'000'000);
+  ASSERT_GT(t.ratio(0), 0.0);
+  ASSERT_LE(t.ratio(0), 1.1);
+  ASSERT_LT(t.ratio(1), 0.5);
+  ASSERT_EQ(t.ratios().size(), 2);
+
+  std::stringstream ss;
+  report(t, ss);
+  auto out = ss.str();
+  ASSERT_EQ(std::count(out.begin(), out.end(), ','), 5);
+}
+
+TEST(Timer, Sched) {
+  using namespace std::chrono_literals;
+  SchedTimer<> blocked(true);
+  std::this_thread::sleep_for(30ms);
+  blocked.Stop();
+  ASSERT_GE(blocked.voluntary_switches(), 1);
+
+  SchedTimer<> running(true);
+  auto until = std::chrono::steady_clock::now() + 20ms;
+  while (std::chrono::steady_clock::now() < until) {
+  }
+  running.Stop();
+
+  std::stringstream ss;
+  report(running, ss);
+  auto out = ss.str();
+  ASSERT_EQ(std::count(out.begin(), out.end(), ','), 5);
+
+  if (!blocked.valid() || !running.valid()) GTEST_SKIP() << "schedstat is unavailable";
+  ASSERT_GE(blocked.blocked_nanoseconds(), 20'000'000);
+  ASSERT_LT(blocked.run_nanoseconds(), 10'000'000);
+  ASSERT_GT(running.run_nanoseconds(), 0);
+  ASSERT_LE(running.run_nanoseconds() + running.runqueue_nanoseconds(),
+            running.nanoseconds() + 5'000'000);
+}
+#endif
+
+TEST(Timer, Ticks) {
+  Timer<> t;
+  t.start_ = Timer<>::point(std::chrono::milliseconds(1000));
+  t.stop_ = Timer<>::point(std::chrono::milliseconds(1250));
+
+  ASSERT_EQ(t.nanoseconds(), 250000000);
+  ASSERT_EQ(t.seconds(), 0.25);
+}
+
+TEST(Timer, TicksConversion) {
+  using micro = internal::Ticks<std::micro>;
+  ASSERT_EQ(micro::nanoseconds(3), 3000);
+  using third = internal::Ticks<std::ratio<1, 3000000000>>;
+  ASSERT_EQ(third::nanoseconds(3000000000), 1000000000);
+  ASSERT_EQ(third::nanoseconds(-3), -1);
+  // A year of ticks of a 3 GHz clock, and a period with a whole and a fractional part.
+  ASSERT_EQ(third::nanoseconds(94608000000000001), 31536000000000000);
+  using three_halves = internal::Ticks<std::ratio<3, 2000000000>>;
+  ASSERT_EQ(three_halves::nanoseconds(7), 10);
+  ASSERT_EQ(three_halves::nanoseconds(-7), -10);
+  ASSERT_EQ(three_halves::seconds(2000000000), 3.0);
+}
+
+TEST(Timer, SplitTicks) {
+  using namespace std::chrono_literals;
+  SplitTimer<2> t;
+  t.splits[0] = SplitTimer<2>::point(1s);
+  t.splits[1] = SplitTimer<2>::point(1s + 10ms);
+  t.splits[2] = SplitTimer<2>::point(1s + 30ms);
+
+  ASSERT_EQ(t.nanoseconds(0), 10000000);
+  ASSERT_EQ(t.nanoseconds(1), 20000000);
+  ASSERT_EQ(t.total_nanoseconds(), 30000000);
 }
 
 TEST(Timer, SplitCopyConstruct) {
@@ -0,0 +1,78 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <thread>
+
+#include "putong/timer.h"
+#include "putong/tsc_skew.h"
+
+namespace putong {
+
+#if PUTONG_HAS_TSC
+
+TEST(TscSkew, Measure) {
+  auto cpus = OnlineCpus();
+  auto skew = TscSkew::Measure(100);
+  ASSERT_EQ(skew.offset(cpus.front()), 0);
+  ASSERT_EQ(skew.uncertainty(cpus.front()), 0);
+  ASSERT_TRUE(skew.measured(cpus.front()));
+#if defined(__linux__)
+  // CPUs outside the affinity mask of the process cannot be measured.
+  cpu_set_t allowed;
+  ASSERT_EQ(sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+  if (CPU_ISSET(cpus.front(), &allowed)) {
+    for (auto cpu : cpus) {
+      ASSERT_EQ(skew.measured(cpu), CPU_ISSET(cpu, &allowed) != 0);
+    }
+  }
+#endif
+
+  auto r = TscSkew::Read();
+  ASSERT_GE(r.cpu, 0);
+  ASSERT_EQ(skew.Correct(r), r.tsc - skew.offset(r.cpu));
+}
+
+TEST(TscSkew, Timer) {
+  using namespace std::chrono_literals;
+  // Pin a temporary thread, so that the affinity of the test thread is left alone.
+  std::thread([] {
+    auto cpus = OnlineCpus();
+    TscTimer t;
+    bool pinned = PinThisThread(cpus.front());
+    t.Start();
+    pinned = PinThisThread(cpus.back()) && pinned;
+    std::this_thread::sleep_for(20ms);
+    t.Stop();
+
+    if (pinned) {
+      ASSERT_EQ(t.crossed_cores(), cpus.size() > 1);
+    }
+    ASSERT_GT(t.seconds(), 0.019);
+    // Correcting the readings of two different CPUs with the wrong offsets or sign would
+    // be off by far more than the sleep can overrun, so this bound can be loose.
+    ASSERT_LT(t.seconds(), 0.5);
+  }).join();
+
+  Timer<corrected_tsc_clock> c(true);
+  std::this_thread::sleep_for(20ms);
+  c.Stop();
+  ASSERT_GT(c.seconds(), 0.019);
+}
+
+#endif
+
+}  // namespace putong
@@ -0,0 +1,71 @@
+// Copyright 2020 Delft University of Technology
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include "putong/zone.h"
+
+namespace putong {
+
+namespace {
+
+void Kernel() {
+  using namespace std::chrono_literals;
+  PUTONG_ZONE("kernel");
+  std::this_thread::sleep_for(5ms);
+}
+
+void Query() {
+  PUTONG_ZONE("query");
+  Kernel();
+  Kernel();
+}
+
+}  // namespace
+
+TEST(Zone, Nested) {
+  auto& profiler = ZoneProfiler::Global();
+  profiler.Reset();
+
+  auto request = [] {
+    PUTONG_ZONE("request");
+    Query();
+  };
+  request();
+  std::thread(request).join();
+
+  auto nodes = profiler.Collect();
+  ASSERT_EQ(nodes.size(), 4);
+  ASSERT_STREQ(nodes[1].label, "request");
+  ASSERT_STREQ(nodes[2].label, "query");
+  ASSERT_STREQ(nodes[3].label, "kernel");
+  ASSERT_EQ(nodes[3].parent, 2);
+  ASSERT_EQ(nodes[3].depth, 3);
+  ASSERT_EQ(nodes[1].count, 2);
+  ASSERT_EQ(nodes[3].count, 4);
+  ASSERT_GE(nodes[3].inclusive_ns, 20'000'000);
+  ASSERT_EQ(nodes[3].self_ns, nodes[3].inclusive_ns);
+  ASSERT_GE(nodes[2].inclusive_ns, nodes[3].inclusive_ns);
+  ASSERT_EQ(nodes[2].self_ns, nodes[2].inclusive_ns - nodes[3].inclusive_ns);
+
+  auto folded = profiler.FoldedStacks();
+  ASSERT_THAT(folded, testing::HasSubstr("request;query;kernel " +
+                                         std::to_string(nodes[3].self_ns) + "\n"));
+}
+
+}  // namespace putong